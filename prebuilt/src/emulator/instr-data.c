@@ -73,8 +73,8 @@ char *argless_instr_name[] = {
   "RESET-ALARM-COUNTER",
   "MAKE-HEAVYWEIGHT-THREAD",	/* 70 */
   "TEST-AND-SET-LOCATIVE",
-  "ILLEGAL-ARGLESS-72",
-  "ILLEGAL-ARGLESS-73",
+  "GC-STATISTIC",
+  "IDENTITY-HASH",
   "ILLEGAL-ARGLESS-74",
   "ILLEGAL-ARGLESS-75",
   "ILLEGAL-ARGLESS-76",
@@ -167,4 +167,33 @@ char *instr_name[] = {
   "FILLTAG",
   "^SUPER-CXT",
   "^SUPER-TAIL",
+  "LOAD-STK/CAR/LOAD-STK",
+  "LOAD-STK/LOAD-STK/CAR",
+  "LOAD-STK/EQ?/BRANCH-NIL",
+  "EQ?/BRANCH-NIL",
+  "LOAD-STK/BRANCH-T",
+  "LOAD-STK/BRANCH-NIL",	/* 40 */
+  "LOAD-IMM-FIX/LOAD-STK/CAR",
+  "LOAD-BP/LOAD-STK/CAR",
+  "POP/LOAD-BP/LOAD-STK",
+  "LOAD-STK/CDR/BRANCH",
+  "LOAD-STK/LOAD-IMM-FIX/LOAD-STK",
+  "EQ?/LOAD-STK/CAR",
+  "POP/LOAD-STK/CAR",
+  "LOAD-STK/</BRANCH-NIL",
+  "LOAD-IMM-FIX/LOAD-IMM-FIX/LOAD-STK",
+  "LOAD-BP/RETURN",	/* 50 */
+  "ILLEGAL-ARGED-51",
+  "ILLEGAL-ARGED-52",
+  "ILLEGAL-ARGED-53",
+  "ILLEGAL-ARGED-54",
+  "ILLEGAL-ARGED-55",
+  "ILLEGAL-ARGED-56",
+  "ILLEGAL-ARGED-57",
+  "ILLEGAL-ARGED-58",
+  "ILLEGAL-ARGED-59",
+  "ILLEGAL-ARGED-60",	/* 60 */
+  "ILLEGAL-ARGED-61",
+  "ILLEGAL-ARGED-62",
+  "ILLEGAL-ARGED-63",
 };
@@ -0,0 +1,306 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <signal.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "gc.h"
+#include "allocprof.h"
+
+#ifdef ALLOCATION_PROFILE
+
+/*
+ * Allocation site sampling, for --profile-allocation.
+ *
+ * Each register set counts down the words its thread allocates, and
+ * every alloc_sample_words words ALLOCATE_PROT() records where the
+ * allocation is being made: the method, its code vector and the offset
+ * of the pc in it.  When sampling is off the count starts so high that
+ * it never runs out, so the cost is a subtraction and a test.
+ *
+ * Samples go into a ring buffer, which is emptied into a hash table of
+ * sites when it fills and at every gc.  As with the other tables outside
+ * the heap, after each gc the keys are moved to where the code vectors
+ * they name survived; the samples of those that did not are kept
+ * together.  The table is written out at exit, and on SIGUSR2 at the
+ * next sample.
+ */
+
+#define ALLOC_RING_SIZE 1024
+#define ALLOC_SITES_INITIAL_SIZE 1024
+
+typedef struct
+{
+  ref_t method, segment;
+  unsigned long pc, words;
+} alloc_sample_t;
+
+typedef struct
+{
+  ref_t method, segment;	/* segment is 0 if the slot is empty */
+  unsigned long pc;
+  unsigned long samples, words;
+} alloc_site_t;
+
+char *alloc_profile_file_name = NULL;	/* set by --profile-allocation */
+long alloc_sample_words = 4096;
+
+static alloc_sample_t alloc_ring[ALLOC_RING_SIZE];
+static unsigned long alloc_ring_count = 0;
+
+static alloc_site_t *alloc_sites = NULL;
+static unsigned long alloc_sites_mask;
+static unsigned long alloc_sites_count = 0;	/* slots in use */
+
+/* Samples of code vectors the gc has since collected. */
+static unsigned long collected_samples = 0, collected_words = 0;
+
+static volatile sig_atomic_t alloc_report_requested = 0;
+
+#ifdef THREADS
+static pthread_mutex_t alloc_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#define ALLOC_SITE_HASH(seg, pc) \
+  ((unsigned long)(((u_int32_t)(seg) + (u_int32_t)(pc)) * 2654435769u) >> 4)
+
+static alloc_site_t *
+alloc_site_slot(alloc_site_t * table, unsigned long mask, ref_t seg,
+		unsigned long pc)
+{
+  unsigned long i = ALLOC_SITE_HASH(seg, pc) & mask;
+
+  while (table[i].segment != 0
+	 && (table[i].segment != seg || table[i].pc != pc))
+    i = (i + 1) & mask;
+  return &table[i];
+}
+
+/* Rebuild the table with size slots.  If forward, the references in
+   each entry are moved to where they survived the gc, and entries for
+   code vectors that did not are dropped. */
+static void
+rehash_alloc_sites(unsigned long size, bool forward)
+{
+  alloc_site_t *old = alloc_sites;
+  unsigned long i, old_size = old ? alloc_sites_mask + 1 : 0;
+
+  alloc_sites = (alloc_site_t *) xmalloc(size * sizeof(alloc_site_t));
+  alloc_sites_mask = size - 1;
+  alloc_sites_count = 0;
+  for (i = 0; i < size; i++)
+    alloc_sites[i].segment = 0;
+
+  for (i = 0; i < old_size; i++)
+    {
+      alloc_site_t e = old[i];
+      alloc_site_t *s;
+
+      if (e.segment == 0)
+	continue;
+      if (forward && !(gc_forward(&e.segment) && gc_forward(&e.method)))
+	{
+	  collected_samples += e.samples;
+	  collected_words += e.words;
+	  continue;
+	}
+      /* Two sites may have become one if a code vector was collected
+	 and another made in its place. */
+      s = alloc_site_slot(alloc_sites, alloc_sites_mask, e.segment, e.pc);
+      if (s->segment == 0)
+	{
+	  *s = e;
+	  alloc_sites_count += 1;
+	}
+      else
+	{
+	  s->samples += e.samples;
+	  s->words += e.words;
+	}
+    }
+
+  free(old);
+}
+
+static void
+add_alloc_sample(alloc_sample_t * a)
+{
+  alloc_site_t *s =
+    alloc_site_slot(alloc_sites, alloc_sites_mask, a->segment, a->pc);
+
+  if (s->segment == 0)
+    {
+      /* Keep the load factor under one half. */
+      if (2 * (alloc_sites_count + 1) > alloc_sites_mask + 1)
+	{
+	  rehash_alloc_sites(2 * (alloc_sites_mask + 1), false);
+	  s = alloc_site_slot(alloc_sites, alloc_sites_mask,
+			      a->segment, a->pc);
+	}
+      s->segment = a->segment;
+      s->method = a->method;
+      s->pc = a->pc;
+      s->samples = s->words = 0;
+      alloc_sites_count += 1;
+    }
+  s->samples += 1;
+  s->words += a->words;
+}
+
+static void
+drain_alloc_ring(void)
+{
+  unsigned long i;
+
+  for (i = 0; i < alloc_ring_count; i++)
+    add_alloc_sample(&alloc_ring[i]);
+  alloc_ring_count = 0;
+}
+
+static int
+alloc_site_compare(const void *a, const void *b)
+{
+  const alloc_site_t *x = *(alloc_site_t * const *)a;
+  const alloc_site_t *y = *(alloc_site_t * const *)b;
+
+  return x->words < y->words ? 1 : x->words > y->words ? -1 : 0;
+}
+
+static void
+write_allocation_profile(void)
+{
+  FILE *f = fopen(alloc_profile_file_name, WRITE_MODE);
+  alloc_site_t **sorted;
+  unsigned long i, n = 0, samples = collected_samples;
+
+  if (f == NULL)
+    {
+      fprintf(stderr, "Unable to open allocation profile file %s.\n",
+	      alloc_profile_file_name);
+      return;
+    }
+
+  drain_alloc_ring();
+  sorted = (alloc_site_t **) xmalloc((alloc_sites_count + 1)
+				     * sizeof(alloc_site_t *));
+  for (i = 0; i <= alloc_sites_mask; i++)
+    if (alloc_sites[i].segment != 0)
+      {
+	sorted[n++] = &alloc_sites[i];
+	samples += alloc_sites[i].samples;
+      }
+  qsort(sorted, n, sizeof(alloc_site_t *), alloc_site_compare);
+
+  fprintf(f, "; Allocation profile: %lu samples, one every %ld words.\n"
+	  ";     samples  words sampled  method  code vector  pc\n",
+	  samples, alloc_sample_words);
+  for (i = 0; i < n; i++)
+    {
+      fprintf(f, "%13lu %14lu  ", sorted[i]->samples, sorted[i]->words);
+      printref(f, sorted[i]->method);
+      fprintf(f, "  ");
+      printref(f, sorted[i]->segment);
+      fprintf(f, "  %lu\n", sorted[i]->pc);
+    }
+  if (collected_samples)
+    fprintf(f, "%13lu %14lu  in code since collected\n",
+	    collected_samples, collected_words);
+
+  free(sorted);
+  fclose(f);
+}
+
+/* Called by ALLOCATE_PROT() when the thread's count runs out, with the
+   registers up to date. */
+void
+sample_allocation(long words)
+{
+#ifdef THREADS
+  int my_index = *(int *)pthread_getspecific(index_key);
+#endif
+  alloc_sample_t *a;
+
+  reg_set->alloc_countdown = ALLOCATION_COUNTDOWN();
+  if (alloc_profile_file_name == NULL)
+    return;
+
+#ifdef THREADS
+  pthread_mutex_lock(&alloc_profile_lock);
+#endif
+  if (alloc_ring_count == ALLOC_RING_SIZE)
+    drain_alloc_ring();
+  a = &alloc_ring[alloc_ring_count++];
+  a->method = e_current_method;
+  a->segment = e_code_segment;
+  a->pc = e_pc - CODE_SEG_FIRST_INSTR(e_code_segment);
+  a->words = words;
+
+  if (alloc_report_requested)
+    {
+      alloc_report_requested = 0;
+      write_allocation_profile();
+    }
+#ifdef THREADS
+  pthread_mutex_unlock(&alloc_profile_lock);
+#endif
+}
+
+/* The gc is over, so move the samples along with the code. */
+void
+post_gc_allocation_profile(void)
+{
+  if (alloc_profile_file_name == NULL)
+    return;
+  drain_alloc_ring();
+  rehash_alloc_sites(alloc_sites_mask + 1, true);
+}
+
+static void
+request_allocation_profile(int sig)
+{
+  alloc_report_requested = 1;
+}
+
+static void
+exit_allocation_profile(void)
+{
+#ifdef THREADS
+  pthread_mutex_lock(&alloc_profile_lock);
+#endif
+  write_allocation_profile();
+#ifdef THREADS
+  pthread_mutex_unlock(&alloc_profile_lock);
+#endif
+}
+
+void
+init_allocation_profile(void)
+{
+  rehash_alloc_sites(ALLOC_SITES_INITIAL_SIZE, false);
+  if (signal(SIGUSR2, request_allocation_profile) == SIG_ERR)
+    fprintf(stderr, "Cannot catch SIGUSR2 for the allocation profile.\n");
+  atexit(exit_allocation_profile);
+}
+
+#endif
@@ -0,0 +1,40 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _ALLOCPROF_H_INCLUDED
+#define _ALLOCPROF_H_INCLUDED
+
+#include <limits.h>
+#include "config.h"
+#include "data.h"
+
+#ifdef ALLOCATION_PROFILE
+
+extern char *alloc_profile_file_name;
+extern long alloc_sample_words;
+
+extern void init_allocation_profile(void);
+extern void post_gc_allocation_profile(void);
+
+/* What a fresh register set counts down from. */
+#define ALLOCATION_COUNTDOWN() \
+  (alloc_profile_file_name ? alloc_sample_words : LONG_MAX)
+
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "gc.h"
+#include "census.h"
+
+/*
+ * The heap census.
+ *
+ * Every object a full gc finds live is counted under its type, in an
+ * open addressed hash table keyed by the type.  The keys are the types
+ * as they were before the gc, so like the other tables outside the heap
+ * the table is rebuilt after every gc, full or not, with each key moved
+ * to where its type survived.  Each entry remembers the previous
+ * census too, so each report shows how each type has grown since the
+ * last.
+ *
+ * Types carry no names in the emulator, so the report shows each type
+ * the way printref() does.  The i of [i;tag:3;s] is what %POINTER gives
+ * for the type in the world, and %CRUNCH turns it back into the type, so
+ * until the next full gc moves it again the world can name it:
+ * (%crunch i %pointer-tag) prints as, say, #<Type CONS-PAIR 3>.
+ */
+
+#define CENSUS_INITIAL_SIZE 256
+
+typedef struct
+{
+  ref_t type;			/* 0 if the slot is empty */
+  unsigned long count, words;
+  unsigned long previous_count, previous_words;
+} census_entry_t;
+
+FILE *heap_census_file = NULL;
+bool census_active = false;
+
+static census_entry_t *census_table = NULL;
+static unsigned long census_mask;
+static unsigned long census_count = 0;	/* slots in use */
+
+#ifdef PARALLEL_GC
+static pthread_mutex_t census_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#define CENSUS_HASH(type) \
+  ((unsigned long)((u_int32_t)(type) * 2654435769u) >> 4)
+
+static census_entry_t *
+census_slot(census_entry_t * table, unsigned long mask, ref_t type)
+{
+  unsigned long i = CENSUS_HASH(type) & mask;
+
+  while (table[i].type != 0 && table[i].type != type)
+    i = (i + 1) & mask;
+  return &table[i];
+}
+
+/* Rebuild the table with size slots, keeping only the entries keep()
+   returns true for, which may change their keys. */
+static void
+rehash_census_table(unsigned long size, bool (*keep) (census_entry_t *))
+{
+  census_entry_t *old = census_table;
+  unsigned long i, old_size = old ? census_mask + 1 : 0;
+
+  census_table = (census_entry_t *) xmalloc(size * sizeof(census_entry_t));
+  census_mask = size - 1;
+  census_count = 0;
+  for (i = 0; i < size; i++)
+    census_table[i].type = 0;
+
+  for (i = 0; i < old_size; i++)
+    if (old[i].type != 0 && (keep == NULL || keep(&old[i])))
+      {
+	*census_slot(census_table, census_mask, old[i].type) = old[i];
+	census_count += 1;
+      }
+
+  free(old);
+}
+
+static bool
+census_keep_recent(census_entry_t * e)
+{
+  /* Last time's counts become the previous ones. */
+  e->previous_count = e->count;
+  e->previous_words = e->words;
+  e->count = e->words = 0;
+  return e->previous_count != 0;
+}
+
+void
+census_begin(void)
+{
+  if (census_table == NULL)
+    rehash_census_table(CENSUS_INITIAL_SIZE, NULL);
+  else
+    rehash_census_table(census_mask + 1, census_keep_recent);
+  census_active = true;
+}
+
+void
+census_note(ref_t type, unsigned long words)
+{
+  census_entry_t *e;
+
+#ifdef PARALLEL_GC
+  pthread_mutex_lock(&census_lock);
+#endif
+  e = census_slot(census_table, census_mask, type);
+  if (e->type == 0)
+    {
+      /* Keep the load factor under one half. */
+      if (2 * (census_count + 1) > census_mask + 1)
+	{
+	  rehash_census_table(2 * (census_mask + 1), NULL);
+	  e = census_slot(census_table, census_mask, type);
+	}
+      e->type = type;
+      e->count = e->words = 0;
+      e->previous_count = e->previous_words = 0;
+      census_count += 1;
+    }
+  e->count += 1;
+  e->words += words;
+#ifdef PARALLEL_GC
+  pthread_mutex_unlock(&census_lock);
+#endif
+}
+
+static bool
+census_forward(census_entry_t * e)
+{
+  return gc_forward(&e->type);
+}
+
+/* Move the keys along with the types. */
+void
+post_gc_census(void)
+{
+  if (census_table != NULL)
+    rehash_census_table(census_mask + 1, census_forward);
+}
+
+static int
+census_compare(const void *a, const void *b)
+{
+  const census_entry_t *x = *(census_entry_t * const *)a;
+  const census_entry_t *y = *(census_entry_t * const *)b;
+
+  return x->words < y->words ? 1 : x->words > y->words ? -1 : 0;
+}
+
+/* Write the census just taken, the types taking the most space
+   first. */
+void
+census_report(unsigned long gc_number)
+{
+  census_entry_t **sorted =
+    (census_entry_t **) xmalloc((census_count + 1)
+				* sizeof(census_entry_t *));
+  unsigned long i, n = 0, count = 0, words = 0;
+
+  census_active = false;
+  for (i = 0; i <= census_mask; i++)
+    if (census_table[i].type != 0)
+      {
+	sorted[n++] = &census_table[i];
+	count += census_table[i].count;
+	words += census_table[i].words;
+      }
+  qsort(sorted, n, sizeof(census_entry_t *), census_compare);
+
+  fprintf(heap_census_file,
+	  "; Heap census after gc %lu: %lu objects in %lu words.\n"
+	  ";     objects        words    +/-objects      +/-words"
+	  "  type (length)\n", gc_number, count, words);
+  for (i = 0; i < n; i++)
+    {
+      census_entry_t *e = sorted[i];
+
+      fprintf(heap_census_file, "%13lu %12lu %+13ld %+13ld  ",
+	      e->count, e->words,
+	      (long)(e->count - e->previous_count),
+	      (long)(e->words - e->previous_words));
+      printref(heap_census_file, e->type);
+      if (REF_SLOT(e->type, TYPE_VAR_LEN_P_OFF) == e_nil)
+	fprintf(heap_census_file, " (%ld)\n",
+		(long)REF_TO_INT(REF_SLOT(e->type, TYPE_LEN_OFF)));
+      else
+	fprintf(heap_census_file, " (variable)\n");
+    }
+  fflush(heap_census_file);
+  free(sorted);
+}
@@ -0,0 +1,42 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _CENSUS_H_INCLUDED
+#define _CENSUS_H_INCLUDED
+
+#include <stdio.h>
+#include "config.h"
+#include "data.h"
+
+/* The heap census: after each full gc, the number of live objects of
+   each type and the words they take, written to heap_census_file. */
+
+extern FILE *heap_census_file;
+extern bool census_active;
+
+/* Called by the gc for each live object it finds, with its type as it
+   was before the gc. */
+#define CENSUS(type, len) \
+  { if (census_active) census_note((type), (len)); }
+
+extern void census_begin(void);
+extern void census_note(ref_t type, unsigned long words);
+extern void post_gc_census(void);
+extern void census_report(unsigned long gc_number);
+
+#endif
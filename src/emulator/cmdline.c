@@ -33,6 +33,11 @@
 #include "cmdline.h"
 #include "xmalloc.h"
 #include "stacks.h"
+#include "profile.h"
+#include "allocprof.h"
+#include "gc.h"
+#include "heap.h"
+#include "census.h"
 
 enum {
   FLAG_ARG = 0,
@@ -43,10 +48,20 @@ enum {
   DUMP_BASE_ARG,
   PREDUMP_GC_ARG,
   HEAP_ARG,
+  MAX_HEAP_ARG,
+  GC_OVERHEAD_ARG,
+  MIN_FREE_ARG,
   VALSIZ_ARG,
   CXTSIZ_ARG,
   MAX_SEG_ARG,
   VERBOSE_GC_ARG,
+  GC_THREADS_ARG,
+  GC_MAX_PAUSE_ARG,
+  GC_LOG_ARG,
+  HEAP_CENSUS_ARG,
+  PROFILE_INSTRUCTIONS_ARG,
+  PROFILE_ALLOCATION_ARG,
+  ALLOCATION_SAMPLE_ARG,
 };
 
 
@@ -78,13 +93,33 @@ usage(char *prog)
 	  "\t--predump-gc b       0=no, 1=yes; default=1\n"
 	  "\n"
 	  "\t--size-heap n        n is in kilo-refs, default %d\n"
+	  "\t--max-heap n         n is in kilo-refs, default=cgroup limit/2\n"
+	  "\t--target-gc-overhead p\n"
+	  "\t                     grow heap while gc takes over p%%; default=5\n"
+	  "\t--min-free-ratio p   leave p%% of new space free; default=67\n"
 	  "\t--size-val-stk n     value stack buffer, n is in refs\n"
 	  "\t--size-cxt-stk n     context stack buffer, n is in refs\n"
 	  "\t--size-seg-max n     maximum flushed segment len, n is in refs\n"
 	  "\n"
 	  "\t--trace-gc v         0=quiet, 3=very detailed; default=0\n"
 	  "\t--verbose-gc v       synonym for --trace-gc\n"
+#ifdef PARALLEL_GC
+	  "\t--gc-threads n       scavenge on n threads; default=1\n"
+#endif
+	  "\t--gc-max-pause-ms n  target minor gc pause in ms; default=0, none\n"
+	  "\t--gc-log file        write a line describing each gc to file\n"
+	  "\t--heap-census file   after each full gc write live objects by type\n"
 	  "\t--trace-traps\n"
+#ifdef PROFILE_INSTRUCTIONS
+	  "\t--profile-instructions file\n"
+	  "\t                     write instruction and pair counts to file\n"
+#endif
+#ifdef ALLOCATION_PROFILE
+	  "\t--profile-allocation file\n"
+	  "\t                     write sampled allocation sites to file\n"
+	  "\t--allocation-sample-words n\n"
+	  "\t                     sample every n words allocated; default=4096\n"
+#endif
 #ifndef FAST
 	  "\t--trace-segs         trace stack segment writes/reads\n"
 	  "\t--trace-valcon       print entire value stack at each instr\n"
@@ -92,7 +127,8 @@ usage(char *prog)
 	  "\t--trace-stks         print the size of the stacks at each instr\n"
 	  "\t--trace-instructions trace each bytecode executed\n"
 	  "\t--trace-methods      trace each method lookup\n"
-#ifdef OP_TYPE_METH_CACHE
+#if defined(OP_TYPE_METH_CACHE) || defined(CALL_SITE_CACHE) \
+    || defined(METHOD_TABLE)
 	  "\t--trace-mcache       trace method cache\n"
 #endif
 #endif
@@ -162,11 +198,29 @@ parse_cmd_line(int argc, char **argv)
 	{"dump-base", required_argument, 0, DUMP_BASE_ARG},
 	{"predump-gc", required_argument, 0, PREDUMP_GC_ARG},
 	{"size-heap", required_argument, 0, HEAP_ARG},
+	{"max-heap", required_argument, 0, MAX_HEAP_ARG},
+	{"target-gc-overhead", required_argument, 0, GC_OVERHEAD_ARG},
+	{"min-free-ratio", required_argument, 0, MIN_FREE_ARG},
 	{"size-val-stk", required_argument, 0, VALSIZ_ARG},
 	{"size-cxt-stk", required_argument, 0, CXTSIZ_ARG},
 	{"size-seg-max", required_argument, 0, MAX_SEG_ARG},
 	{"trace-gc", required_argument, 0, VERBOSE_GC_ARG},
+#ifdef PARALLEL_GC
+	{"gc-threads", required_argument, 0, GC_THREADS_ARG},
+#endif
+	{"gc-max-pause-ms", required_argument, 0, GC_MAX_PAUSE_ARG},
+	{"gc-log", required_argument, 0, GC_LOG_ARG},
+	{"heap-census", required_argument, 0, HEAP_CENSUS_ARG},
 	{"trace-traps", no_argument, &trace_traps, true},
+#ifdef PROFILE_INSTRUCTIONS
+	{"profile-instructions", required_argument, 0,
+	 PROFILE_INSTRUCTIONS_ARG},
+#endif
+#ifdef ALLOCATION_PROFILE
+	{"profile-allocation", required_argument, 0, PROFILE_ALLOCATION_ARG},
+	{"allocation-sample-words", required_argument, 0,
+	 ALLOCATION_SAMPLE_ARG},
+#endif
 #ifndef FAST
 	{"trace-segs", no_argument, &trace_segs, true},
 	{"trace-valcon", no_argument, &trace_valcon, true},
@@ -174,7 +228,8 @@ parse_cmd_line(int argc, char **argv)
 	{"trace-stks", no_argument, &trace_stks, true},
 	{"trace-instructions", no_argument, &trace_insts, true},
 	{"trace-methods", no_argument, &trace_meth, true},
-#ifdef OP_TYPE_METH_CACHE
+#if defined(OP_TYPE_METH_CACHE) || defined(CALL_SITE_CACHE) \
+    || defined(METHOD_TABLE)
 	{"trace-mcache", no_argument, &trace_mcache, true},
 #endif
 #endif
@@ -230,6 +285,30 @@ parse_cmd_line(int argc, char **argv)
 	  original_newspace_size = 1024 * atol(optarg);
 	  break;
 
+	case MAX_HEAP_ARG:
+	  max_heap_size = 1024 * atol(optarg);
+	  break;
+
+	case GC_OVERHEAD_ARG:
+	  target_gc_overhead = atol(optarg);
+	  if (target_gc_overhead < 1 || target_gc_overhead > 100)
+	    {
+	      fprintf(stderr, "Error (command line parser): invalid"
+		      " gc overhead %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+
+	case MIN_FREE_ARG:
+	  min_free_ratio = atol(optarg);
+	  if (min_free_ratio > 99)
+	    {
+	      fprintf(stderr, "Error (command line parser): invalid"
+		      " free ratio %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+
 	case VALSIZ_ARG:
 	  value_stack.size = atoi(optarg);
 	  value_stack.filltarget = value_stack.size/2;
@@ -248,6 +327,64 @@ parse_cmd_line(int argc, char **argv)
 	  trace_gc = atoi(optarg);
 	  break;
 
+#ifdef PARALLEL_GC
+	case GC_THREADS_ARG:
+	  gc_threads = atoi(optarg);
+	  if (gc_threads < 1)
+	    {
+	      fprintf(stderr, "Error (command line parser): invalid"
+		      " number of gc threads %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+#endif
+
+	case GC_MAX_PAUSE_ARG:
+	  gc_max_pause_ms = atol(optarg);
+	  break;
+
+	case GC_LOG_ARG:
+	  gc_log = fopen(optarg, "w");
+	  if (gc_log == NULL)
+	    {
+	      fprintf(stderr, "Error (command line parser): unable to"
+		      " open gc log %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+
+	case HEAP_CENSUS_ARG:
+	  heap_census_file = fopen(optarg, "w");
+	  if (heap_census_file == NULL)
+	    {
+	      fprintf(stderr, "Error (command line parser): unable to"
+		      " open heap census %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+
+#ifdef PROFILE_INSTRUCTIONS
+	case PROFILE_INSTRUCTIONS_ARG:
+	  profile_file_name = optarg;
+	  break;
+#endif
+
+#ifdef ALLOCATION_PROFILE
+	case PROFILE_ALLOCATION_ARG:
+	  alloc_profile_file_name = optarg;
+	  break;
+
+	case ALLOCATION_SAMPLE_ARG:
+	  alloc_sample_words = atol(optarg);
+	  if (alloc_sample_words < 1)
+	    {
+	      fprintf(stderr, "Error (command line parser): invalid"
+		      " sample interval %s.\n", optarg);
+	      exit(EXIT_FAILURE);
+	    }
+	  break;
+#endif
+
 	case HELP_ARG:
 	  usage(argv[0]);
 	  exit(EXIT_SUCCESS);
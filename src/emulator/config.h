@@ -75,9 +75,107 @@
 #define OP_METH_ALIST_MTF
 #endif
 
-/* Activate operation-type method cache. */
+/* Activate operation-type method cache.  It lives in the operation
+   objects, so it cannot be used with threads. */
 #ifndef THREADS
 #define OP_TYPE_METH_CACHE
 #endif
 
+/* Activate polymorphic inline caches at FUNCALL call sites, consulted
+   before the operation-type method cache.  Define NO_CALL_SITE_CACHE
+   to turn them off.  With threads, each thread has its own. */
+#ifndef NO_CALL_SITE_CACHE
+#define CALL_SITE_CACHE
+#endif
+
+/* Activate a global (operation, type) method table, consulted when the
+   caches above miss, before searching the type hierarchy.  Define
+   NO_METHOD_TABLE to turn it off.  With threads, each thread has its
+   own. */
+#ifndef NO_METHOD_TABLE
+#define METHOD_TABLE
+#endif
+
+/* Mark the cards of spatic space that are stored into, so that a gc
+   which is not full scans only those instead of all of spatic space.
+   Define NO_CARD_MARKING to turn it off. */
+#ifndef NO_CARD_MARKING
+#define CARD_MARKING
+#endif
+
+/* With threads, let the gc scavenge on several threads at once when
+   asked to with --gc-threads.  Define NO_PARALLEL_GC to turn it
+   off. */
+#if defined(THREADS) && !defined(NO_PARALLEL_GC)
+#define PARALLEL_GC
+#endif
+
+/* With threads, let each thread allocate from a buffer of new space
+   of its own without taking alloc_lock.  Define NO_TLABS to turn it
+   off. */
+#if defined(THREADS) && !defined(NO_TLABS)
+#define TLABS
+#endif
+
+/* Collect garbage in a full gc by marking and then sliding what is live
+   down in place, rather than by copying it to a fresh space, so that
+   the heap need not be doubled.  Define NO_MARK_COMPACT to copy. */
+#ifndef NO_MARK_COMPACT
+#define MARK_COMPACT
+#endif
+
+/* Map the spaces of the heap, and keep those the gc lets go of for
+   reuse, rather than malloc()ing and free()ing them.  Define
+   NO_MMAP_SPACES to use malloc(). */
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) \
+    && !defined(NO_MMAP_SPACES)
+#define MMAP_SPACES
+#endif
+
+/* Give objects made by VLEN-ALLOCATE that are at least
+   LARGE_OBJECT_WORDS long pages of their own outside the heap, where
+   the gc marks them rather than copying them.  Needs MMAP_SPACES and
+   CARD_MARKING.  Define NO_LARGE_OBJECTS to turn it off. */
+#if defined(MMAP_SPACES) && defined(CARD_MARKING) \
+    && !defined(NO_LARGE_OBJECTS)
+#define LARGE_OBJECTS
+#endif
+
+/* Let --profile-allocation sample where allocation happens.  When it
+   is not given this costs a subtraction and a test per allocation.
+   Define NO_ALLOCATION_PROFILE to turn it off. */
+#ifndef NO_ALLOCATION_PROFILE
+#define ALLOCATION_PROFILE
+#endif
+
+/* Dispatch instructions with computed gotos through tables of label
+   addresses, a GCC extension, instead of through a switch.  Define
+   NO_THREADED_DISPATCH to fall back to the portable switch. */
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+/* Run hot code vectors from side tables of predecoded instructions.
+   Needs THREADED_DISPATCH, and the tables are not shared safely
+   between threads. */
+#if defined(THREADED_DISPATCH) && !defined(THREADS) \
+    && !defined(NO_PREDECODE)
+#define PREDECODE
+#endif
+
+/* Keep the top of the value stack in a local variable of loop(),
+   which the C compiler can put in a register, rather than in the
+   stack buffer.  Needs the GCC statement expression extension. */
+// #define TOS_CACHING
+#if defined(TOS_CACHING) && !defined(__GNUC__)
+#undef TOS_CACHING
+#endif
+
+/* Count instructions for --profile-instructions.  Unoptimized
+   emulators always can; define PROFILE_INSTRUCTIONS to get it in FAST
+   builds too. */
+#ifndef FAST
+#define PROFILE_INSTRUCTIONS
+#endif
+
 #endif
@@ -33,6 +33,10 @@
 
 space_t new_space, old_space, spatic;
 
+#ifdef CARD_MARKING
+u_int8_t *spatic_cards = NULL;
+#endif
+
 ref_t *free_point = 0;
 
 #ifndef THREADS
@@ -91,6 +91,13 @@ typedef struct {
   u_int16_t *e_pc;
   unsigned  e_nargs;
   ref_t     e_process;
+#ifdef TLABS
+  ref_t     *tlab_point;	/* the thread's allocation buffer */
+  ref_t     *tlab_end;
+#endif
+#ifdef ALLOCATION_PROFILE
+  long      alloc_countdown;	/* words until the next sample */
+#endif
 } register_set_t;
 
 
@@ -135,7 +142,8 @@ extern bool trace_cxtcon;
 extern bool trace_stks;
 extern bool trace_meth;
 
-#ifdef OP_TYPE_METH_CACHE
+#if defined(OP_TYPE_METH_CACHE) || defined(CALL_SITE_CACHE) \
+    || defined(METHOD_TABLE)
 extern bool trace_mcache;
 #endif
 
@@ -295,7 +303,49 @@ if ((highcrap) && (highcrap != 0xe0000000)) {code;}}
 #define SPACE_PTR(s,p)	((s).start<=(p) && (p)<(s).end)
 #define NEW_PTR(r)      SPACE_PTR(new_space,(r))
 #define SPATIC_PTR(r)	SPACE_PTR(spatic,(r))
-#define OLD_PTR(r) (SPACE_PTR(old_space,(r))||(full_gc&&SPACE_PTR(spatic,(r))))
+#define OLD_PTR(r) (SPACE_PTR(old_space,(r))				\
+		    ||(full_gc&&(SPACE_PTR(spatic,(r))||EVACUATED_PTR(r))))
+
+/* The large object space, where objects too big to be worth copying
+   stay put.  Its pages are cards too.  Before a world is dumped its
+   objects are evacuated, copied into the heap like those in old
+   space. */
+#ifdef LARGE_OBJECTS
+#define LARGE_PAGE_SHIFT	10
+extern space_t large_space;
+extern u_int8_t *large_cards;
+extern bool large_evacuating;
+#define LARGE_PTR(r)	SPACE_PTR(large_space,(r))
+#define LARGE_PAGE(p)	((size_t)((p) - large_space.start) >> LARGE_PAGE_SHIFT)
+#define EVACUATED_PTR(r) (large_evacuating && LARGE_PTR(r))
+#define LARGE_BARRIER(p)				\
+	else if (LARGE_PTR(p))				\
+	  large_cards[LARGE_PAGE(p)] = 1;
+#else
+#define large_evacuating false
+#define EVACUATED_PTR(r) 0
+#define LARGE_BARRIER(p)
+#endif
+
+/* The card table for spatic space, one byte per 2^CARD_SHIFT words.
+   Stores into spatic space mark their card, so a gc that leaves
+   spatic space in place need only scan marked cards for references
+   into the space being collected. */
+#ifdef CARD_MARKING
+#ifndef CARD_SHIFT
+#define CARD_SHIFT	7
+#endif
+extern u_int8_t *spatic_cards;
+#define CARD_INDEX(p)	((size_t)((p) - spatic.start) >> CARD_SHIFT)
+#define WRITE_BARRIER(p)				\
+{	ref_t *MACROq = (p);				\
+	if (SPATIC_PTR(MACROq))				\
+	  spatic_cards[CARD_INDEX(MACROq)] = 1;		\
+	LARGE_BARRIER(MACROq)				\
+}
+#else
+#define WRITE_BARRIER(p)
+#endif
 
 
 
@@ -306,6 +356,24 @@ if ((highcrap) && (highcrap != 0xe0000000)) {code;}}
    e_nil : wp_table[1+(u_int32_t)REF_TO_INT((r))] )
 
 
+/* Count allocation towards the next sample of --profile-allocation.
+   The registers must be unlocalized around the sample. */
+
+#ifdef ALLOCATION_PROFILE
+extern void sample_allocation(long words);
+#define ALLOCATION_SAMPLE(words, before, after)		\
+{							\
+  if ((reg_set->alloc_countdown -= (words)) < 0)	\
+    {							\
+      before;						\
+      sample_allocation(words);				\
+      after;						\
+    }							\
+}
+#else
+#define ALLOCATION_SAMPLE(words, before, after) {}
+#endif
+
 /* This is used to allocate some storage.  It calls gc when necessary. */
 
 #define ALLOCATE(p, words, reason)			\
@@ -315,12 +383,14 @@ if ((highcrap) && (highcrap != 0xe0000000)) {code;}}
 
 #define ALLOCATE_SS(p, words, reason)			\
   ALLOCATE_PROT(p, words, reason,			\
-		{ value_stack.sp = local_value_sp;	\
+		{ SPILL_TOS();				\
+		  value_stack.sp = local_value_sp;	\
           context_stack.sp = local_context_sp;		\
 		  e_pc = local_epc; },			\
 		{ local_epc = e_pc;			\
           local_context_sp = context_stack.sp;		\
-		  local_value_sp = value_stack.sp; })
+		  local_value_sp = value_stack.sp;	\
+		  FILL_TOS(); })
 
 
 /* This allocates some storage, assuming that v must be protected from gc. */
@@ -328,17 +398,59 @@ if ((highcrap) && (highcrap != 0xe0000000)) {code;}}
 #define ALLOCATE1(p, words, reason, v)			\
   ALLOCATE_PROT(p, words, reason,			\
 		{ GC_MEMORY(v);				\
+		  SPILL_TOS();				\
 		  value_stack.sp = local_value_sp;	\
           context_stack.sp = local_context_sp;		\
 		  e_pc = local_epc; },			\
 		{ local_epc = e_pc;			\
           local_context_sp = context_stack.sp;		\
 		  local_value_sp = value_stack.sp;	\
+		  FILL_TOS();				\
 		  GC_RECALL(v); })
 
 
+#ifdef TLABS
+
+/* Words are bumped off the thread's allocation buffer, and only getting
+   another buffer takes alloc_lock. */
+
+#ifndef TLAB_SIZE
+#define TLAB_SIZE 2048
+#endif
+
+extern bool tlab_refill(register_set_t * regs, ref_t ** pp, long words);
+extern void tlab_retire(register_set_t * regs);
+
 #define ALLOCATE_PROT(p, words, reason, before, after)	\
 {							\
+  ALLOCATION_SAMPLE((words), before, after);		\
+  if (reg_set->tlab_point + (words) <= reg_set->tlab_end) \
+    {							\
+      (p) = reg_set->tlab_point;			\
+      reg_set->tlab_point += (words);			\
+    }							\
+  else							\
+    {							\
+      while (pthread_mutex_trylock(&alloc_lock) != 0) {	\
+	      if (gc_pending) {				\
+		      before; wait_for_gc(); after;	\
+	      }						\
+      }							\
+      while (!tlab_refill(reg_set, &(p), (words)))	\
+	{						\
+	  before;					\
+	  gc(false, false, (reason), (words) + TLAB_SIZE); \
+	  after;					\
+	}						\
+      pthread_mutex_unlock (&alloc_lock);		\
+    }							\
+}
+
+#else
+
+#define ALLOCATE_PROT(p, words, reason, before, after)	\
+{							\
+  ALLOCATION_SAMPLE((words), before, after);		\
   THREADY(						\
       while (pthread_mutex_trylock(&alloc_lock) != 0) {	\
 	      if (gc_pending) {				\
@@ -357,6 +469,8 @@ if ((highcrap) && (highcrap != 0xe0000000)) {code;}}
   THREADY( pthread_mutex_unlock (&alloc_lock); )	\
 }
 
+#endif
+
 /* These get slots out of Oaklisp objects, and may be used as lvalues. */
 
 #define SLOT(p,s)	(*((p)+(s)))
@@ -26,28 +26,26 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sched.h>
 #include "data.h"
 #include "weak.h"
+#include "idhash.h"
+#include "predecode.h"
+#include "mcache.h"
+#include "large.h"
+#include "heap.h"
+#include "census.h"
+#include "allocprof.h"
 #include "xmalloc.h"
 #include "stacks.h"
 #include "gc.h"
-
-
-#ifdef USE_VADVISE
-#include <sys/vadvise.h>
-#endif
+#include "timers.h"
 
 
 #define FORTHREADS THREADY( for (my_index=0; my_index<next_index; my_index++) )
 
 
-
-/* 1/RECLAIM_FACTOR is the target for how much of new space should
-   be used after a gc.  If more than this is used, the next new
-   space allocated will be bigger. */
-
-#define RECLAIM_FACTOR 3
-
 bool full_gc = false;
 
 ref_t pre_gc_nil;
@@ -67,6 +65,13 @@ ref_t gc_examine_buffer[GC_EXAMINE_BUFFER_SIZE];
 ref_t *gc_examine_ptr = gc_examine_buffer;
 #endif
 
+#ifdef LARGE_OBJECTS
+static void large_touch(ref_t * p);
+#define LARGE_TOUCH(p)	{ if (LARGE_PTR(p)) large_touch(p); }
+#else
+#define LARGE_TOUCH(p)
+#endif
+
 #define GC_TOUCH(x)			\
 {					\
   if ((x)&PTR_MASK)			\
@@ -75,6 +80,8 @@ ref_t *gc_examine_ptr = gc_examine_buffer;
 					\
       if (OLD_PTR(MACROp))		\
 	(x) = gc_touch0((x));		\
+      else				\
+	LARGE_TOUCH(MACROp);		\
     }					\
 }
 
@@ -142,12 +149,13 @@ printref(FILE * fd, ref_t refin)
    that it will work in the middle of a gc, when an object's type might
    already have been transported. */
 
+/* The length of x, whose type slot holds typ.  The parallel scavenger
+   passes typ in, as by then the type slot may have been claimed. */
 static unsigned long
-gc_get_length(ref_t x)
+gc_get_length(ref_t x, ref_t typ)
 {
   if (TAG_IS(x, PTR_TAG))
     {
-      ref_t typ = REF_SLOT(x, 0);
       ref_t vlen_p = REF_SLOT(typ, TYPE_VAR_LEN_P_OFF);
       ref_t len;
 
@@ -199,12 +207,13 @@ gc_touch0(ref_t r)
 	  {
 	    /* Transport it */
 	    long i;
-	    long len = gc_get_length(r);
+	    long len = gc_get_length(r, type_slot);
 	    ref_t *new_place = free_point;
 	    ref_t *p0 = p;
 	    ref_t *q0 = new_place;
 
 	    transport_count += 1;
+	    CENSUS(type_slot, len);
 
 	    /*
 	       fprintf(stderr, "About to transport ");
@@ -252,108 +261,1507 @@ gc_touch0(ref_t r)
 	    r1 = *pp;
 	    /* chain_len += 1; */
 
-	    if (r0 == r1)
-	      {
-		/* fprintf(stderr, "Circular locative chain.\n"); */
-		goto forwarded_loc;
-	      }
-	    if (!TAG_IS(r1, LOC_TAG) || (pp = LOC_TO_PTR(r1), !OLD_PTR(pp)))
-	      break;
+	    if (r0 == r1)
+	      {
+		/* fprintf(stderr, "Circular locative chain.\n"); */
+		goto forwarded_loc;
+	      }
+	    if (!TAG_IS(r1, LOC_TAG) || (pp = LOC_TO_PTR(r1), !OLD_PTR(pp)))
+	      break;
+
+	    r1 = *pp;
+	    /* chain_len += 1; */
+	  }
+
+	/* We're on an object, so touch it. */
+	/*
+	   fprintf(stderr, "Locative chain followed to ");
+	   printref(r1);
+	   fprintf(stderr, " requiring %d dereferences.\n", chain_len);
+	 */
+	GC_TOUCH(r1);
+	/* (void)gc_touch(r1); */
+
+	/* Now see if we're looking at a forwarding pointer. */
+      forwarded_loc:
+	return (r);
+      }
+  else
+    return (r);
+}
+
+static ref_t
+loc_touch0(ref_t r, bool warn_if_unmoved)
+{
+  ref_t *p = LOC_TO_PTR(r);
+
+  if (OLD_PTR(p))
+    {
+      /* A locative into old space.  See if it's been transported yet. */
+      ref_t r1 = *p;
+      if (TAG_IS(r1, LOC_TAG) && NEW_PTR(LOC_TO_PTR(r1)))
+	/* Already been transported. */
+	return (r1);
+      else
+	{
+	  /* Better transport this lonely cell. */
+
+	  ref_t *new_place = free_point++;	/* make a new cell. */
+	  ref_t new_r = PTR_TO_LOC(new_place);
+
+#ifndef FAST
+	  if (free_point >= new_space.end)
+	    {
+	      fprintf(stderr,
+		      "\n; New space exhausted while transporting the cell ");
+	      printref(stderr, r);
+	      fprintf(stderr,
+		      ".\n; This indicates a bug in the garbage collector.\n");
+	      exit(EXIT_FAILURE);
+	    }
+#endif
+	  *p = new_r;		/* Record the transportation. */
+
+	  /* Put the right value in the new cell. */
+
+	  *new_place =
+	    TAG_IS(r1, PTR_TAG) && (p = REF_TO_PTR(r1), OLD_PTR(p))
+	    ? *p | 1 : r1;
+	  /* ? PTR_TO_REF(REF_TO_PTR(*p)) : r1; */
+
+	  loc_transport_count += 1;
+
+	  if (warn_if_unmoved)
+	    {
+	      fprintf(stderr, "\nWarning: the locative ");
+	      printref(stderr, r);
+	      fprintf(stderr, " has just had its raw cell moved.\n");
+	    }
+	  return (new_r);
+	}
+    }
+  else
+    return (r);			/* Not a locative into old space. */
+}
+
+
+#ifdef LARGE_OBJECTS
+/* Have the large object p is in touched, if the gc has just found it. */
+static void
+large_touch(ref_t * p)
+{
+  long len;
+  ref_t *start = large_mark(p, &len);
+
+  if (start)
+    {
+      CENSUS(start[0], len);
+      large_push_pending(start);
+    }
+}
+
+/* Touch the large objects found since last time.  Returns false if
+   there were none. */
+static bool
+large_scavenge(void)
+{
+  ref_t *p, *end;
+  long len;
+  bool found = false;
+
+  while ((p = large_pop_pending(&len)) != NULL)
+    {
+      found = true;
+      for (end = p + len; p < end; p++)
+	GC_TOUCH(*p);
+    }
+  return found;
+}
+
+/* Like spatic_touch(), touch the marked cards of the large objects
+   this gc is not collecting, or in the locative pass of all those that
+   survive it. */
+static void
+large_cards_touch(bool loc_phase)
+{
+  ref_t *obj, *p, *end, *card_end;
+  long len;
+
+  for (obj = large_next_object(NULL, &len); obj;
+       obj = large_next_object(obj, &len))
+    {
+      if (loc_phase ? !large_live(obj) : large_collectable(obj))
+	continue;
+      for (p = obj, end = obj + len; p < end; p = card_end)
+	{
+	  card_end = large_space.start
+	    + ((LARGE_PAGE(p) + 1) << LARGE_PAGE_SHIFT);
+	  if (card_end > end)
+	    card_end = end;
+	  if (!large_cards[LARGE_PAGE(p)])
+	    continue;
+	  if (loc_phase)
+	    {
+	      for (; p < card_end; p++)
+		LOC_TOUCH(*p);
+	    }
+	  else
+	    {
+	      for (; p < card_end; p++)
+		GC_TOUCH(*p);
+	    }
+	}
+    }
+}
+
+/* Free the large objects that died, and unmark the cards of the others
+   that no longer refer to new space. */
+static void
+large_post_gc(void)
+{
+  unsigned long count;
+
+  if (large_object_count == 0)
+    return;
+  if (trace_gc > 1)
+    fprintf(stderr, "; Sweeping large objects...");
+  count = large_sweep();
+  if (trace_gc > 1)
+    fprintf(stderr, " %lu freed, %ld left.\n", count, large_object_count);
+  count = post_gc_large_cards();
+  if (trace_gc > 1)
+    fprintf(stderr, "; %lu large object card%s still marked.\n",
+	    count, count != 1 ? "s" : "");
+}
+#else
+#define large_scavenge() false
+#endif
+
+static void
+scavenge(void)
+{
+  ref_t *scavenge_p = new_space.start;
+
+  do
+    {
+      for (; scavenge_p < free_point; scavenge_p += 1)
+	GC_TOUCH(*scavenge_p);
+    }
+  while (large_scavenge());
+}
+
+static void
+loc_scavenge(void)
+{
+  ref_t *scavenge_p;
+
+  for (scavenge_p = new_space.start; scavenge_p < free_point; scavenge_p += 1)
+    LOC_TOUCH(*scavenge_p);
+}
+
+#ifdef CARD_MARKING
+static size_t spatic_card_count = 0;
+
+/* Give spatic space, which has just been loaded or replaced, a card
+   table with no cards marked. */
+void
+reset_spatic_cards(void)
+{
+  free(spatic_cards);
+  spatic_card_count = (spatic.size + (1 << CARD_SHIFT) - 1) >> CARD_SHIFT;
+  spatic_cards = (u_int8_t *) xmalloc(spatic_card_count + 1);
+  memset(spatic_cards, 0, spatic_card_count + 1);
+}
+
+/* Loop p over the words of the marked cards of spatic space. */
+#define FOR_MARKED_CARDS(card,p,end)					\
+  for ((card) = 0; (card) < spatic_card_count; (card)++)		\
+    if (spatic_cards[(card)])						\
+      for ((p) = spatic.start + ((card) << CARD_SHIFT),			\
+	   (end) = (p) + (1 << CARD_SHIFT) < spatic.end			\
+	     ? (p) + (1 << CARD_SHIFT) : spatic.end;			\
+	   (p) < (end); (p)++)
+#endif
+
+/* When spatic space is not being collected, all of it that might refer
+   to old space is a root. */
+
+static void
+spatic_touch(void)
+{
+  ref_t *p;
+#ifdef CARD_MARKING
+  ref_t *end;
+  size_t card;
+
+  FOR_MARKED_CARDS(card, p, end)
+    GC_TOUCH(*p);
+#else
+  for (p = spatic.start; p < spatic.end; p++)
+    GC_TOUCH(*p);
+#endif
+}
+
+static void
+spatic_loc_touch(void)
+{
+  ref_t *p;
+#ifdef CARD_MARKING
+  ref_t *end;
+  size_t card;
+
+  FOR_MARKED_CARDS(card, p, end)
+    LOC_TOUCH(*p);
+#else
+  for (p = spatic.start; p < spatic.end; p++)
+    LOC_TOUCH(*p);
+#endif
+}
+
+#ifdef CARD_MARKING
+/* Unmark the cards that no longer refer to new space, so the next gc
+   need not scan them.  Returns the number left marked. */
+static unsigned long
+post_gc_cards(void)
+{
+  ref_t *p, *end;
+  size_t card;
+  unsigned long marked_count = 0;
+
+  for (card = 0; card < spatic_card_count; card++)
+    if (spatic_cards[card])
+      {
+	p = spatic.start + (card << CARD_SHIFT);
+	end = p + (1 << CARD_SHIFT) < spatic.end
+	  ? p + (1 << CARD_SHIFT) : spatic.end;
+	for (; p < end; p++)
+	  if ((*p & PTR_MASK) && NEW_PTR(ANY_TO_PTR(*p)))
+	    break;
+	if (p < end)
+	  marked_count += 1;
+	else
+	  spatic_cards[card] = 0;
+      }
+  return marked_count;
+}
+#endif
+
+#ifdef PARALLEL_GC
+
+/*
+ * The parallel scavenger.
+ *
+ * With --gc-threads n for n > 1, gc() still touches the registers and
+ * stacks itself, but then n workers, gc()'s own thread being the first,
+ * share the scan of spatic space and of new space.  The scan looks at a
+ * word at a time, not an object at a time, so any range of words that
+ * has been copied can be scanned by any worker.
+ *
+ * Each worker copies objects into a chunk of new space it has claimed
+ * from free_point and scans them from there.  When the chunk fills up
+ * and it claims another, what it had not yet scanned of the old chunk
+ * goes on its queue, from which idle workers steal.  Large objects are
+ * given space of their own and go on the queue directly.  The unused
+ * ends of chunks are filled with fixnums.
+ *
+ * A worker transports an object after swapping GC_BUSY into its type
+ * slot, and installs the forwarding locatives once the copy is done.
+ * Others that find GC_BUSY wait for the forwarding locative.  Cells are
+ * claimed the same way in the locative pass.
+ */
+
+#ifndef GC_CHUNK_SIZE
+#define GC_CHUNK_SIZE 1024
+#endif
+
+/* Words of spatic space, or of new space copied before the workers
+   start, claimed at a time. */
+#define GC_BLOCK_SIZE (8 * GC_CHUNK_SIZE)
+
+/* A chunk with at least this many words left is kept when an object
+   does not fit in it, and the object is given space of its own. */
+#define GC_CHUNK_WASTE (GC_CHUNK_SIZE / 32)
+
+/* What a type slot or cell holds while it is being transported: a
+   locative to a word outside the heap.  No type slot or cell can hold
+   that otherwise, whereas a cell may well hold any fixnum. */
+static ref_t gc_busy_word;
+#define GC_BUSY PTR_TO_LOC(&gc_busy_word)
+
+int gc_threads = 1;
+
+typedef struct
+{
+  ref_t *start, *end;
+} gc_range_t;
+
+typedef struct
+{
+  int index;
+  ref_t *scan, *alloc, *limit;	/* the current chunk */
+  gc_range_t *queue;
+  size_t queue_size;
+  volatile size_t queue_head, queue_tail;
+  pthread_mutex_t queue_lock;
+  unsigned long transport_count;
+} gc_worker_t;
+
+static gc_worker_t *gc_workers = NULL;
+static bool par_loc_phase, par_scan_spatic;
+static volatile int active_workers, idle_workers;
+static volatile size_t spatic_cursor, copied_cursor;
+static size_t copied_size;
+
+static ref_t par_gc_touch0(gc_worker_t * w, ref_t r);
+static ref_t par_loc_touch0(gc_worker_t * w, ref_t r);
+
+#ifdef LARGE_OBJECTS
+static void par_large_touch(gc_worker_t * w, ref_t * p);
+#define PAR_LARGE_TOUCH(w,p)	{ if (LARGE_PTR(p)) par_large_touch((w),(p)); }
+#else
+#define PAR_LARGE_TOUCH(w,p)
+#endif
+
+#define PAR_GC_TOUCH(w,x)		\
+{					\
+  if ((x)&PTR_MASK)			\
+    {					\
+      ref_t *MACROp = ANY_TO_PTR((x));	\
+					\
+      if (OLD_PTR(MACROp))		\
+	(x) = par_gc_touch0((w),(x));	\
+      else				\
+	PAR_LARGE_TOUCH((w),MACROp);	\
+    }					\
+}
+
+#define PAR_LOC_TOUCH(w,x)			\
+{						\
+  if (TAG_IS((x),LOC_TAG))			\
+    {						\
+      ref_t *MACROp = LOC_TO_PTR((x));		\
+						\
+      if (OLD_PTR(MACROp))			\
+	(x) = par_loc_touch0((w),(x));		\
+    }						\
+}
+
+
+static void
+par_push(gc_worker_t * w, ref_t * start, ref_t * end)
+{
+  pthread_mutex_lock(&w->queue_lock);
+  while (start < end)
+    {
+      if (w->queue_tail == w->queue_size)
+	{
+	  gc_range_t *old = w->queue;
+	  size_t n = w->queue_tail - w->queue_head;
+
+	  if (2 * n > w->queue_size)
+	    {
+	      w->queue_size *= 2;
+	      w->queue =
+		(gc_range_t *) xmalloc(w->queue_size * sizeof(gc_range_t));
+	    }
+	  memmove(w->queue, &old[w->queue_head], n * sizeof(gc_range_t));
+	  if (w->queue != old)
+	    free(old);
+	  w->queue_head = 0;
+	  w->queue_tail = n;
+	}
+      w->queue[w->queue_tail].start = start;
+      start = end - start > GC_CHUNK_SIZE ? start + GC_CHUNK_SIZE : end;
+      w->queue[w->queue_tail].end = start;
+      w->queue_tail += 1;
+    }
+  pthread_mutex_unlock(&w->queue_lock);
+}
+
+/* Take the range pushed last.  Only w itself pushes onto its queue, so
+   it need not lock to see that it is empty. */
+static bool
+par_pop(gc_worker_t * w, gc_range_t * r)
+{
+  bool found = false;
+
+  if (w->queue_tail == w->queue_head)
+    return false;
+  pthread_mutex_lock(&w->queue_lock);
+  if (w->queue_tail > w->queue_head)
+    {
+      *r = w->queue[--w->queue_tail];
+      found = true;
+    }
+  pthread_mutex_unlock(&w->queue_lock);
+  return found;
+}
+
+/* Take the range pushed first onto some other worker's queue. */
+static bool
+par_steal(gc_worker_t * w, gc_range_t * r)
+{
+  int i;
+
+  for (i = 1; i < gc_threads; i++)
+    {
+      gc_worker_t *v = &gc_workers[(w->index + i) % gc_threads];
+      bool found = false;
+
+      if (v->queue_tail == v->queue_head)
+	continue;
+      pthread_mutex_lock(&v->queue_lock);
+      if (v->queue_tail > v->queue_head)
+	{
+	  *r = v->queue[v->queue_head++];
+	  found = true;
+	}
+      pthread_mutex_unlock(&v->queue_lock);
+      if (found)
+	return true;
+    }
+  return false;
+}
+
+/* Claim the next block of words [base, base+size) through cursor. */
+static bool
+par_claim(volatile size_t * cursor, ref_t * base, size_t size,
+	  gc_range_t * r)
+{
+  size_t b = __sync_fetch_and_add(cursor, GC_BLOCK_SIZE);
+
+  if (b >= size)
+    return false;
+  r->start = base + b;
+  r->end = base + (b + GC_BLOCK_SIZE < size ? b + GC_BLOCK_SIZE : size);
+  return true;
+}
+
+static ref_t *
+par_claim_new_space(long len)
+{
+  ref_t *q = (ref_t *)
+    __sync_fetch_and_add((unsigned long *)&free_point,
+			 len * sizeof(ref_t));
+
+  if (q + len > new_space.end)
+    {
+      fprintf(stderr, "\n; New space exhausted while transporting %ld words"
+	      " in parallel.\n"
+	      "; This indicates a bug in the garbage collector.\n", len);
+      exit(EXIT_FAILURE);
+    }
+  return q;
+}
+
+static void
+par_retire_chunk(gc_worker_t * w)
+{
+  ref_t *p;
+
+  if (w->scan < w->alloc)
+    par_push(w, w->scan, w->alloc);
+  for (p = w->alloc; p < w->limit; p++)
+    *p = INT_TO_REF(0);
+  w->scan = w->alloc = w->limit;
+}
+
+/* Find room for len words in new space.  Sets *direct if they are not
+   in w's chunk, and so must be pushed onto its queue to be scanned. */
+static ref_t *
+par_alloc(gc_worker_t * w, long len, bool * direct)
+{
+  ref_t *q = w->alloc;
+
+  *direct = false;
+  if (q + len <= w->limit)
+    {
+      w->alloc = q + len;
+      return q;
+    }
+  if (w->limit - w->alloc >= GC_CHUNK_WASTE || len > GC_CHUNK_SIZE / 2)
+    {
+      *direct = true;
+      return par_claim_new_space(len);
+    }
+  par_retire_chunk(w);
+  q = par_claim_new_space(GC_CHUNK_SIZE);
+  w->scan = q;
+  w->alloc = q + len;
+  w->limit = q + GC_CHUNK_SIZE;
+  return q;
+}
+
+
+static ref_t
+par_gc_touch0(gc_worker_t * w, ref_t r)
+{
+  ref_t *p = ANY_TO_PTR(r);
+
+  if (r & 1)
+    {
+      ref_t type_slot;
+      long i, len;
+      bool direct;
+      ref_t *q;
+
+      do
+	{
+	  while ((type_slot = *(volatile ref_t *)p) == GC_BUSY)
+	    ;
+	  if (TAG_IS(type_slot, LOC_TAG))
+	    /* Already been transported. */
+	    return type_slot | 1L;
+	}
+      while (!__sync_bool_compare_and_swap(p, type_slot, GC_BUSY));
+
+      len = gc_get_length(r, type_slot);
+      q = par_alloc(w, len, &direct);
+      w->transport_count += 1;
+      CENSUS(type_slot, len);
+
+      q[0] = type_slot;
+      for (i = 1; i < len; i++)
+	q[i] = p[i];
+
+      /* Anyone who finds a forwarding locative may look at the copy. */
+      __sync_synchronize();
+      *(volatile ref_t *)p = PTR_TO_LOC(q);
+      for (i = 1; i < len; i++)
+	p[i] = PTR_TO_LOC(q + i);
+
+      if (direct)
+	par_push(w, q, q + len);
+      return PTR_TO_REF(q);
+    }
+  else
+    {
+      /* As in gc_touch0(). */
+      ref_t r0 = r, r1 = *p, *pp;
+
+      while (TAG_IS(r1, LOC_TAG) && (pp = LOC_TO_PTR(r1), OLD_PTR(pp)))
+	{
+	  if (r0 == r1)
+	    return r;
+	  r0 = *LOC_TO_PTR(r0);
+	  r1 = *pp;
+	  if (r0 == r1)
+	    return r;
+	  if (!TAG_IS(r1, LOC_TAG) || (pp = LOC_TO_PTR(r1), !OLD_PTR(pp)))
+	    break;
+	  r1 = *pp;
+	}
+      PAR_GC_TOUCH(w, r1);
+      return r;
+    }
+}
+
+static ref_t
+par_loc_touch0(gc_worker_t * w, ref_t r)
+{
+  ref_t *p = LOC_TO_PTR(r);
+  ref_t r1;
+  bool direct;
+  ref_t *q;
+
+  do
+    {
+      while ((r1 = *(volatile ref_t *)p) == GC_BUSY)
+	;
+      if (TAG_IS(r1, LOC_TAG) && NEW_PTR(LOC_TO_PTR(r1)))
+	/* Already been transported. */
+	return r1;
+    }
+  while (!__sync_bool_compare_and_swap(p, r1, GC_BUSY));
+
+  q = par_alloc(w, 1, &direct);
+  w->transport_count += 1;
+  *q = TAG_IS(r1, PTR_TAG) && OLD_PTR(REF_TO_PTR(r1))
+    ? *REF_TO_PTR(r1) | 1 : r1;
+  *(volatile ref_t *)p = PTR_TO_LOC(q);
+
+  if (direct)
+    par_push(w, q, q + 1);
+  return PTR_TO_LOC(q);
+}
+
+
+#ifdef LARGE_OBJECTS
+static void
+par_large_touch(gc_worker_t * w, ref_t * p)
+{
+  long len;
+  ref_t *start = large_mark(p, &len);
+
+  if (start)
+    {
+      CENSUS(start[0], len);
+      par_push(w, start, start + len);
+    }
+}
+#endif
+
+static void
+par_scan(gc_worker_t * w, ref_t * start, ref_t * end)
+{
+  ref_t *p;
+
+  if (par_loc_phase)
+    {
+      for (p = start; p < end; p++)
+	PAR_LOC_TOUCH(w, *p);
+    }
+  else
+    {
+      for (p = start; p < end; p++)
+	PAR_GC_TOUCH(w, *p);
+    }
+}
+
+static void
+par_scan_spatic_block(gc_worker_t * w, ref_t * start, ref_t * end)
+{
+#ifdef CARD_MARKING
+  ref_t *p, *card_end;
+
+  for (p = start; p < end; p = card_end)
+    {
+      card_end = spatic.start + ((CARD_INDEX(p) + 1) << CARD_SHIFT);
+      if (card_end > end)
+	card_end = end;
+      if (spatic_cards[CARD_INDEX(p)])
+	par_scan(w, p, card_end);
+    }
+#else
+  par_scan(w, start, end);
+#endif
+}
+
+/* Called when w has run out of work.  Returns true once all the
+   workers have, or false if there might be some to steal. */
+static bool
+par_idle(void)
+{
+  int i;
+
+  __sync_fetch_and_add(&idle_workers, 1);
+  while (1)
+    {
+      if (idle_workers == active_workers)
+	return true;
+      for (i = 0; i < gc_threads; i++)
+	if (gc_workers[i].queue_tail != gc_workers[i].queue_head)
+	  {
+	    __sync_fetch_and_sub(&idle_workers, 1);
+	    return false;
+	  }
+      sched_yield();
+    }
+}
+
+static void *
+par_worker(void *arg)
+{
+  gc_worker_t *w = (gc_worker_t *) arg;
+  gc_range_t r;
+
+  while (1)
+    {
+      while (w->scan < w->alloc)
+	{
+	  ref_t *p = w->scan++;
+
+	  if (par_loc_phase)
+	    {
+	      PAR_LOC_TOUCH(w, *p);
+	    }
+	  else
+	    {
+	      PAR_GC_TOUCH(w, *p);
+	    }
+	}
+
+      if (par_pop(w, &r)
+	  || par_claim(&copied_cursor, new_space.start, copied_size, &r))
+	par_scan(w, r.start, r.end);
+      else if (par_scan_spatic
+	       && par_claim(&spatic_cursor, spatic.start, spatic.size, &r))
+	par_scan_spatic_block(w, r.start, r.end);
+      else if (par_steal(w, &r))
+	par_scan(w, r.start, r.end);
+      else if (par_idle())
+	break;
+    }
+  return NULL;
+}
+
+/* Do the work of scavenge() or, in the locative pass, loc_scavenge(),
+   in parallel, first touching the marked cards of spatic space if
+   scan_spatic. */
+static void
+par_scavenge(bool loc_phase, bool scan_spatic)
+{
+  pthread_t *tids = (pthread_t *) xmalloc(gc_threads * sizeof(pthread_t));
+  bool *started = (bool *) xmalloc(gc_threads * sizeof(bool));
+  unsigned long count = 0;
+  int i;
+
+  if (gc_workers == NULL)
+    {
+      gc_workers = (gc_worker_t *) xmalloc(gc_threads * sizeof(gc_worker_t));
+      for (i = 0; i < gc_threads; i++)
+	{
+	  gc_workers[i].index = i;
+	  gc_workers[i].queue_size = 64;
+	  gc_workers[i].queue =
+	    (gc_range_t *) xmalloc(64 * sizeof(gc_range_t));
+	  pthread_mutex_init(&gc_workers[i].queue_lock, NULL);
+	}
+    }
+
+  for (i = 0; i < gc_threads; i++)
+    {
+      gc_worker_t *w = &gc_workers[i];
+
+      w->scan = w->alloc = w->limit = NULL;
+      w->queue_head = w->queue_tail = 0;
+      w->transport_count = 0;
+    }
+
+  par_loc_phase = loc_phase;
+  par_scan_spatic = scan_spatic;
+  spatic_cursor = copied_cursor = 0;
+  copied_size = free_point - new_space.start;
+  active_workers = gc_threads;
+  idle_workers = 0;
+
+  for (i = 1; i < gc_threads; i++)
+    if (!(started[i] = pthread_create(&tids[i], NULL, par_worker,
+				      &gc_workers[i]) == 0))
+      {
+	/* It had no work yet, so the others can do without it. */
+	__sync_fetch_and_sub(&active_workers, 1);
+	if (trace_gc > 1)
+	  fprintf(stderr, " (gc worker %d not started)", i);
+      }
+  par_worker(&gc_workers[0]);
+  for (i = 1; i < gc_threads; i++)
+    if (started[i])
+      pthread_join(tids[i], NULL);
+
+  for (i = 0; i < gc_threads; i++)
+    {
+      par_retire_chunk(&gc_workers[i]);
+      count += gc_workers[i].transport_count;
+    }
+  if (loc_phase)
+    loc_transport_count += count;
+  else
+    transport_count += count;
+
+  free(tids);
+  free(started);
+}
+
+/* Extra room new space needs for the unused ends of chunks. */
+static size_t
+par_slack(size_t size)
+{
+  return gc_threads > 1 ? size / 16 + 2 * gc_threads * GC_CHUNK_SIZE : 0;
+}
+
+#else
+#define par_slack(size) 0
+#endif
+
+
+/*
+ * Promotion.
+ *
+ * With --gc-max-pause-ms, a gc that follows one which took more than
+ * half the target transports what survives to the end of spatic space
+ * rather than to a fresh new space.  Later gcs then need not copy those
+ * objects again, and as spatic space is only scanned where its cards
+ * are marked, they do not pay for it the way they would for a bigger new
+ * space.  Spatic space is given room to grow into whenever it is
+ * allocated.  Only minor gcs are bounded: a full gc compacts the whole
+ * heap, and takes as long as that takes.
+ */
+
+unsigned long gc_max_pause_ms = 0;
+
+static ref_t *spatic_limit = NULL;	/* end of the room spatic space has */
+static bool promote_next = false;
+
+/* The room to leave past size words of spatic space. */
+static size_t
+spatic_room(size_t size)
+{
+  if (gc_max_pause_ms == 0)
+    return 0;
+  return size > 8 * original_newspace_size ? size : 8 * original_newspace_size;
+}
+
+/* Allocate spatic space for a world of size words. */
+void
+alloc_spatic(size_t size)
+{
+  alloc_space(&spatic, size + spatic_room(size));
+  spatic_limit = spatic.end;
+  spatic.end = spatic.start + size;
+  spatic.size = size;
+#ifdef CARD_MARKING
+  reset_spatic_cards();
+#endif
+}
+
+
+/* Bring the tables outside the heap up to date once what survived is
+   known.  Returns the number of weak pointers discarded. */
+static long
+post_gc_tables(void)
+{
+  long weak_discarded;
+#ifdef THREADS
+  int my_index;
+#endif
+
+  /* Discard weak pointers whose targets did not survive. */
+  if (trace_gc > 1)
+    fprintf(stderr, "; Scanning weak pointer table...");
+  weak_discarded = post_gc_wp();
+  if (trace_gc > 1)
+    fprintf(stderr, " %ld entr%s discarded.\n",
+	    weak_discarded, weak_discarded != 1 ? "ies" : "y");
+
+  /* Move identity hashes along with their objects. */
+  if (trace_gc > 1)
+    fprintf(stderr, "; Rebuilding identity hash tables...");
+  {
+    long count = post_gc_identity_hash();
+
+    if (trace_gc > 1)
+      fprintf(stderr, " %ld entr%s discarded.\n",
+	      count, count != 1 ? "ies" : "y");
+  }
+
+#ifdef PREDECODE
+  /* Move predecoded instructions along with their code vectors. */
+  if (trace_gc > 1)
+    fprintf(stderr, "; Rebuilding predecoded code table...");
+  {
+    long count = post_gc_predecode();
+
+    if (trace_gc > 1)
+      fprintf(stderr, " %ld code vector%s discarded.\n",
+	      count, count != 1 ? "s" : "");
+  }
+#endif
+
+#ifdef METHOD_TABLE
+  /* Move method table entries along with their keys. */
+  if (trace_gc > 1)
+    fprintf(stderr, "; Rebuilding method table...");
+  {
+    long count = 0;
+
+    FORTHREADS {
+      THREADY(if (method_caches == NULL) continue;)
+      count += post_gc_method_table(method_caches);
+    }
+
+    if (trace_gc > 1)
+      fprintf(stderr, " %ld entr%s discarded.\n",
+	      count, count != 1 ? "ies" : "y");
+  }
+#endif
+
+#ifdef CALL_SITE_CACHE
+  /* The call site caches hold references that may have moved. */
+  FORTHREADS {
+    THREADY(if (method_caches == NULL) continue;)
+    flush_call_site_caches(method_caches);
+  }
+#endif
+
+  post_gc_census();
+
+#ifdef ALLOCATION_PROFILE
+  post_gc_allocation_profile();
+#endif
+
+  return weak_discarded;
+}
+
+
+#ifdef MARK_COMPACT
+/*
+ * Mark-compact.
+ *
+ * Copying everything live in a full gc to a fresh space needs room for
+ * it twice over.  Instead, a full gc marks what is live in a bitmap
+ * with a bit per word, and slides it down in place.  Beyond the heap it
+ * needs only the bitmap and a table holding, for each word of the
+ * bitmap, the number of live words below it, each 1/32 the size of the
+ * heap.  As with the copying gc, objects are marked in a first pass and
+ * the cells kept alive only by locatives in a second, so that the new
+ * address of any live word, locatives included, is the number of live
+ * words below it.  What survives in new space is slid onto the end of
+ * spatic space, leaving new space empty as a copying full gc would.  If
+ * spatic space has no room for it, spatic space is slid into a bigger
+ * space instead, which then takes its place.
+ */
+
+typedef struct
+{
+  ref_t *start, *end;		/* the words being compacted */
+  u_int32_t *bits;		/* a bit per word, set if it is live */
+  u_int32_t *below;		/* live words below each word of bits */
+  ref_t *to;			/* where the lowest live word goes */
+  size_t live;			/* number of live words */
+} compact_space_t;
+
+static compact_space_t compact_spaces[2];
+static bool compacting = false;
+
+#define COMPACT_LIVE(c,i)	((c)->bits[(i) >> 5] & (1u << ((i) & 31)))
+
+/* The mark stack holds ranges of marked words still to be scanned.
+   When it overflows the marked words are all scanned again. */
+#ifndef COMPACT_STACK_SIZE
+#define COMPACT_STACK_SIZE 4096
+#endif
+
+static struct
+{
+  ref_t *start, *end;
+} compact_stack[COMPACT_STACK_SIZE];
+static int compact_sp;
+static bool compact_overflow;
+
+static inline unsigned
+popcount32(u_int32_t x)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(x);
+#else
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+}
+
+static compact_space_t *
+compact_space(ref_t * p)
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (compact_spaces[i].start <= p && p < compact_spaces[i].end)
+      return &compact_spaces[i];
+  return NULL;
+}
+
+/* Set n bits from the ith. */
+static void
+compact_set(compact_space_t * c, size_t i, size_t n)
+{
+  for (; n > 0 && (i & 31) != 0; i++, n--)
+    c->bits[i >> 5] |= 1u << (i & 31);
+  for (; n >= 32; i += 32, n -= 32)
+    c->bits[i >> 5] = 0xFFFFFFFF;
+  for (; n > 0; i++, n--)
+    c->bits[i >> 5] |= 1u << (i & 31);
+}
+
+static void
+compact_push(ref_t * start, ref_t * end)
+{
+  if (compact_sp < COMPACT_STACK_SIZE)
+    {
+      compact_stack[compact_sp].start = start;
+      compact_stack[compact_sp].end = end;
+      compact_sp += 1;
+    }
+  else
+    compact_overflow = true;
+}
+
+#ifdef LARGE_OBJECTS
+static void
+compact_mark_large(ref_t * p)
+{
+  long len;
+  ref_t *start = large_mark(p, &len);
+
+  if (start)
+    {
+      CENSUS(start[0], len);
+      compact_push(start, start + len);
+    }
+}
+#endif
+
+static void
+compact_mark(ref_t r)
+{
+  ref_t *p = REF_TO_PTR(r);
+  compact_space_t *c = compact_space(p);
+  long len;
+
+#ifdef LARGE_OBJECTS
+  if (c == NULL && LARGE_PTR(p))
+    compact_mark_large(p);
+#endif
+  if (c == NULL || COMPACT_LIVE(c, p - c->start))
+    return;
+  len = gc_get_length(r, *p);
+  compact_set(c, p - c->start, len);
+  transport_count += 1;
+  CENSUS(*p, len);
+  compact_push(p, p + len);
+}
+
+static void
+compact_mark_cell(ref_t * p)
+{
+  compact_space_t *c = compact_space(p);
+
+  if (c == NULL || COMPACT_LIVE(c, p - c->start))
+    return;
+  compact_set(c, p - c->start, 1);
+  loc_transport_count += 1;
+  compact_push(p, p + 1);
+}
+
+/* Mark what x keeps alive.  In the first pass that is the object it
+   refers to, or for a locative the object at the end of its chain, as
+   in gc_touch0(); in the second it is the cell a locative refers to. */
+static void
+compact_touch(ref_t x, bool loc_phase)
+{
+  if (loc_phase)
+    {
+      if (TAG_IS(x, LOC_TAG))
+	compact_mark_cell(LOC_TO_PTR(x));
+    }
+  else if (TAG_IS(x, PTR_TAG))
+    compact_mark(x);
+  else if (TAG_IS(x, LOC_TAG))
+    {
+      /* The slow end of the chain moves at half speed, to find
+	 circularities. */
+      ref_t slow = x;
+      bool step = false;
+
+      while (TAG_IS(x, LOC_TAG) && compact_space(LOC_TO_PTR(x)))
+	{
+	  x = *LOC_TO_PTR(x);
+	  if (step)
+	    slow = *LOC_TO_PTR(slow);
+	  step = !step;
+	  if (x == slow)
+	    return;
+	}
+#ifdef LARGE_OBJECTS
+      if (TAG_IS(x, LOC_TAG) && LARGE_PTR(LOC_TO_PTR(x)))
+	compact_mark_large(LOC_TO_PTR(x));
+#endif
+      if (TAG_IS(x, PTR_TAG))
+	compact_mark(x);
+    }
+}
+
+static void
+compact_drain(bool loc_phase)
+{
+  ref_t *p, *end;
+
+  while (compact_sp > 0)
+    {
+      compact_sp -= 1;
+      end = compact_stack[compact_sp].end;
+      for (p = compact_stack[compact_sp].start; p < end; p++)
+	compact_touch(*p, loc_phase);
+    }
+}
+
+/* Scan every marked word. */
+static void
+compact_rescan(bool loc_phase)
+{
+  compact_space_t *c;
+  size_t i, n;
+#ifdef LARGE_OBJECTS
+  ref_t *obj, *p, *end;
+  long len;
+
+  for (obj = large_next_object(NULL, &len); obj;
+       obj = large_next_object(obj, &len))
+    if (large_live(obj))
+      for (p = obj, end = obj + len; p < end; p++)
+	{
+	  compact_touch(*p, loc_phase);
+	  compact_drain(loc_phase);
+	}
+#endif
+
+  for (c = compact_spaces; c < compact_spaces + 2; c++)
+    for (i = 0, n = c->end - c->start; i < n; i++)
+      {
+	if ((i & 31) == 0 && c->bits[i >> 5] == 0)
+	  {
+	    i += 31;
+	    continue;
+	  }
+	if (COMPACT_LIVE(c, i))
+	  {
+	    compact_touch(c->start[i], loc_phase);
+	    compact_drain(loc_phase);
+	  }
+      }
+}
+
+static void
+compact_finish_marking(bool loc_phase)
+{
+  compact_drain(loc_phase);
+  while (compact_overflow)
+    {
+      compact_overflow = false;
+      compact_rescan(loc_phase);
+    }
+}
+
+static ref_t *
+compact_new_address(compact_space_t * c, ref_t * p)
+{
+  size_t i = p - c->start;
+
+  return c->to + c->below[i >> 5]
+    + popcount32(c->bits[i >> 5] & ((1u << (i & 31)) - 1));
+}
+
+static ref_t
+compact_update(ref_t x)
+{
+  if (x & PTR_MASK)
+    {
+      ref_t *p = ANY_TO_PTR(x);
+      compact_space_t *c = compact_space(p);
+
+      if (c)
+	return PTR_TO_TAGGED(compact_new_address(c, p), x);
+    }
+  return x;
+}
+
+static void
+compact_root_mark(ref_t * r)
+{
+  compact_touch(*r, false);
+}
+
+static void
+compact_root_mark_cell(ref_t * r)
+{
+  compact_touch(*r, true);
+}
+
+static void
+compact_root_update(ref_t * r)
+{
+  *r = compact_update(*r);
+}
+
+/* Apply visit to each of the roots the copying gc touches, including
+   those held as raw pointers. */
+static void
+compact_roots(void (*visit) (ref_t *))
+{
+  ref_t *p, r;
+#ifdef THREADS
+  int my_index;
+#endif
 
-	    r1 = *pp;
-	    /* chain_len += 1; */
-	  }
+#define VISIT_PTR(x,o)				\
+  {						\
+    r = PTR_TO_REF((x) - (o));			\
+    visit(&r);					\
+    (x) = REF_TO_PTR(r) + (o);			\
+  }
 
-	/* We're on an object, so touch it. */
-	/*
-	   fprintf(stderr, "Locative chain followed to ");
-	   printref(r1);
-	   fprintf(stderr, " requiring %d dereferences.\n", chain_len);
-	 */
-	GC_TOUCH(r1);
-	/* (void)gc_touch(r1); */
+  visit(&e_nil);
+  visit(&e_boot_code);
+  visit(&e_t);
+  visit(&e_fixnum_type);
+  visit(&e_loc_type);
+  visit(&e_cons_type);
+  VISIT_PTR(e_subtype_table, 2);
+  visit(&e_env_type);
+  VISIT_PTR(e_argless_tag_trap_table, 2);
+  VISIT_PTR(e_arged_tag_trap_table, 2);
+  visit(&e_object_type);
+  visit(&e_segment_type);
+  visit(&e_uninitialized);
+  visit(&e_method_type);
+  visit(&e_operation_type);
+
+  FORTHREADS {
+    VISIT_PTR(e_env, 0);
+    visit(&e_code_segment);
+    visit(&e_current_method);
+    visit(&e_process);
+
+    r = PTR_TO_LOC(e_bp);
+    visit(&r);
+    e_bp = LOC_TO_PTR(r);
+
+    r = PTR_TO_LOC((ref_t *) ((unsigned long)e_pc & ~TAG_MASKL));
+    visit(&r);
+    e_pc = (u_int16_t *) ((unsigned long)LOC_TO_PTR(r)
+			  | ((unsigned long)e_pc & TAG_MASK));
+
+    for (p = gc_examine_buffer; p < gc_examine_ptr; p++)
+      visit(p);
+
+    for (p = value_stack.bp; p <= value_stack.sp; p++)
+      visit(p);
+
+    for (p = context_stack.bp; p <= context_stack.sp; p++)
+      visit(p);
+
+    visit(&value_stack.segment);
+    visit(&context_stack.segment);
+  }
 
-	/* Now see if we're looking at a forwarding pointer. */
-      forwarded_loc:
-	return (r);
-      }
-  else
-    return (r);
+#undef VISIT_PTR
 }
 
-static ref_t
-loc_touch0(ref_t r, bool warn_if_unmoved)
+/* Move the live words of c to c->to, keeping their order. */
+static void
+compact_slide(compact_space_t * c)
 {
-  ref_t *p = LOC_TO_PTR(r);
+  size_t i = 0, j, n = c->end - c->start;
+  ref_t *to = c->to;
 
-  if (OLD_PTR(p))
+  while (i < n)
     {
-      /* A locative into old space.  See if it's been transported yet. */
-      ref_t r1 = *p;
-      if (TAG_IS(r1, LOC_TAG) && NEW_PTR(LOC_TO_PTR(r1)))
-	/* Already been transported. */
-	return (r1);
+      if ((i & 31) == 0 && c->bits[i >> 5] == 0)
+	i += 32;
+      else if (!COMPACT_LIVE(c, i))
+	i += 1;
       else
 	{
-	  /* Better transport this lonely cell. */
+	  for (j = i + 1; j < n && COMPACT_LIVE(c, j); j++)
+	    ;
+	  memmove(to, c->start + i, (j - i) * sizeof(ref_t));
+	  to += j - i;
+	  i = j;
+	}
+    }
+}
 
-	  ref_t *new_place = free_point++;	/* make a new cell. */
-	  ref_t new_r = PTR_TO_LOC(new_place);
+/* Do the work of a full gc.  Returns the number of weak pointers
+   discarded. */
+static long
+compact_heap(void)
+{
+  compact_space_t *c;
+  size_t i, n, live, capacity;
+  long weak_discarded;
+  space_t grown;
+
+  compact_spaces[0].start = spatic.start;
+  compact_spaces[0].end = spatic.end;
+  compact_spaces[1].start = new_space.start;
+  compact_spaces[1].end = free_point;
+  for (c = compact_spaces; c < compact_spaces + 2; c++)
+    {
+      n = ((c->end - c->start) + 31) >> 5;
+      c->bits = (u_int32_t *) xmalloc((n + 1) * sizeof(u_int32_t));
+      c->below = (u_int32_t *) xmalloc((n + 1) * sizeof(u_int32_t));
+      memset(c->bits, 0, (n + 1) * sizeof(u_int32_t));
+    }
+  compacting = true;
+  compact_sp = 0;
+  compact_overflow = false;
+  transport_count = 0;
+  loc_transport_count = 0;
 
-#ifndef FAST
-	  if (free_point >= new_space.end)
-	    {
-	      fprintf(stderr,
-		      "\n; New space exhausted while transporting the cell ");
-	      printref(stderr, r);
-	      fprintf(stderr,
-		      ".\n; This indicates a bug in the garbage collector.\n");
-	      exit(EXIT_FAILURE);
-	    }
+  if (trace_gc > 1)
+    fprintf(stderr, " marking...");
+  pre_gc_nil = e_nil;
+  compact_roots(compact_root_mark);
+  compact_finish_marking(false);
+  if (trace_gc > 1)
+    fprintf(stderr, " %ld object%s marked.\n",
+	    transport_count, transport_count != 1 ? "s" : "");
+
+  if (trace_gc > 1)
+    fprintf(stderr, "; Marking cells...");
+  compact_roots(compact_root_mark_cell);
+  compact_rescan(true);
+  compact_finish_marking(true);
+  if (trace_gc > 1)
+    fprintf(stderr, " %ld naked cell%s marked.\n",
+	    loc_transport_count, loc_transport_count != 1 ? "s" : "");
+
+  for (c = compact_spaces; c < compact_spaces + 2; c++)
+    {
+      c->live = 0;
+      for (i = 0, n = ((c->end - c->start) + 31) >> 5; i < n; i++)
+	{
+	  c->below[i] = c->live;
+	  c->live += popcount32(c->bits[i]);
+	}
+    }
+
+  live = compact_spaces[0].live + compact_spaces[1].live;
+  capacity = (spatic_limit ? spatic_limit : spatic.end) - spatic.start;
+  grown.start = NULL;
+  if (live > capacity)
+    {
+      alloc_space(&grown, live + spatic_room(live));
+      capacity = grown.size;
+      compact_spaces[0].to = grown.start;
+    }
+  else
+    compact_spaces[0].to = spatic.start;
+  compact_spaces[1].to = compact_spaces[0].to + compact_spaces[0].live;
+
+  weak_discarded = post_gc_tables();
+
+  if (trace_gc > 1)
+    fprintf(stderr, "; Updating references...");
+  compact_roots(compact_root_update);
+  for (c = compact_spaces; c < compact_spaces + 2; c++)
+    for (i = 0, n = c->end - c->start; i < n; i++)
+      {
+	if ((i & 31) == 0 && c->bits[i >> 5] == 0)
+	  {
+	    i += 31;
+	    continue;
+	  }
+	if (COMPACT_LIVE(c, i))
+	  c->start[i] = compact_update(c->start[i]);
+      }
+#ifdef LARGE_OBJECTS
+  {
+    ref_t *obj, *p, *end;
+    long len;
+
+    for (obj = large_next_object(NULL, &len); obj;
+	 obj = large_next_object(obj, &len))
+      if (large_live(obj))
+	for (p = obj, end = obj + len; p < end; p++)
+	  *p = compact_update(*p);
+  }
 #endif
-	  *p = new_r;		/* Record the transportation. */
 
-	  /* Put the right value in the new cell. */
+  if (trace_gc > 1)
+    fprintf(stderr, " sliding...");
+  compact_slide(&compact_spaces[0]);
+  compact_slide(&compact_spaces[1]);
+  if (trace_gc > 1)
+    fprintf(stderr, " %ld+%ld words live%s.\n",
+	    (long)compact_spaces[0].live, (long)compact_spaces[1].live,
+	    grown.start ? ", spatic space moved to grow" : "");
 
-	  *new_place =
-	    TAG_IS(r1, PTR_TAG) && (p = REF_TO_PTR(r1), OLD_PTR(p))
-	    ? *p | 1 : r1;
-	  /* ? PTR_TO_REF(REF_TO_PTR(*p)) : r1; */
+  if (grown.start)
+    {
+      free_space(&spatic);
+      spatic = grown;
+    }
+  spatic.end = spatic.start + live;
+  spatic.size = live;
+  free_point = new_space.start;
 
-	  loc_transport_count += 1;
+  for (c = compact_spaces; c < compact_spaces + 2; c++)
+    {
+      free(c->bits);
+      free(c->below);
+    }
+  compacting = false;
 
-	  if (warn_if_unmoved)
-	    {
-	      fprintf(stderr, "\nWarning: the locative ");
-	      printref(stderr, r);
-	      fprintf(stderr, " has just had its raw cell moved.\n");
-	    }
-	  return (new_r);
-	}
+  /* Give back what spatic space no longer needs, keeping room for it
+     to grow. */
+  {
+    size_t size = spatic.size, room = spatic_room(size);
+
+    if (size + room > capacity)
+      room = capacity - size;
+    realloc_space(&spatic, size + room);
+    spatic_limit = spatic.end;
+    spatic.end = spatic.start + size;
+    spatic.size = size;
+  }
+
+  if (new_space.size != e_next_newspace_size)
+    {
+      free_space(&new_space);
+      alloc_space(&new_space, e_next_newspace_size);
+      free_point = new_space.start;
     }
-  else
-    return (r);			/* Not a locative into old space. */
-}
 
+#ifdef CARD_MARKING
+  /* New space is empty, so no card refers to it. */
+  reset_spatic_cards();
+#endif
 
-static void
-scavenge(void)
-{
-  ref_t *scavenge_p;
+#ifdef LARGE_OBJECTS
+  large_post_gc();
+#endif
 
-  for (scavenge_p = new_space.start; scavenge_p < free_point; scavenge_p += 1)
-    GC_TOUCH(*scavenge_p);
+  return weak_discarded;
 }
+#endif
 
-static void
-loc_scavenge(void)
+
+bool
+gc_forward(ref_t * r)
 {
-  ref_t *scavenge_p;
+  ref_t *p, r1;
 
-  for (scavenge_p = new_space.start; scavenge_p < free_point; scavenge_p += 1)
-    LOC_TOUCH(*scavenge_p);
+  if (!(*r & PTR_MASK))
+    return true;
+  p = ANY_TO_PTR(*r);
+
+#ifdef MARK_COMPACT
+  if (compacting)
+    {
+      compact_space_t *c = compact_space(p);
+
+#ifdef LARGE_OBJECTS
+      if (c == NULL && LARGE_PTR(p))
+	return large_live(p);
+#endif
+      if (c == NULL)
+	return true;
+      if (!COMPACT_LIVE(c, p - c->start))
+	return false;
+      *r = PTR_TO_TAGGED(compact_new_address(c, p), *r);
+      return true;
+    }
+#endif
+
+#ifdef LARGE_OBJECTS
+  if (!OLD_PTR(p) && LARGE_PTR(p))
+    return large_live(p);
+#endif
+
+  /* An object in old space was transported if its first word is a
+     forwarding locative into new space. */
+  if (!OLD_PTR(p))
+    return true;
+  r1 = *p;
+  if (!(TAG_IS(r1, LOC_TAG) && NEW_PTR(LOC_TO_PTR(r1))))
+    return false;
+  *r = TAG_IS(*r, LOC_TAG) ? r1 : r1 | PTR_TAG;
+  return true;
 }
 
+
 #ifndef FAST
 /* This set of routines are for consistency checks */
 
@@ -364,7 +1772,11 @@ static bool
 gc_check_(ref_t r)
 {
   return (r & PTR_MASK) && !NEW_PTR(ANY_TO_PTR(r))
-    && (full_gc || !SPATIC_PTR(ANY_TO_PTR(r)));
+    && (full_gc || !SPATIC_PTR(ANY_TO_PTR(r)))
+#ifdef LARGE_OBJECTS
+    && !LARGE_PTR(ANY_TO_PTR(r))
+#endif
+    ;
 }
 
 static void
@@ -422,6 +1834,97 @@ pc_touch(u_int16_t * o_pc)
 		   | ((u_int32_t) o_pc & TAG_MASK));
 }
 
+/*
+ * Statistics.
+ *
+ * Each collection adds to the cumulative counters in gc_statistics,
+ * which the world reads with GC-STATISTIC, and with --gc-log writes a
+ * line describing itself to gc_log, as a JSON object.
+ */
+
+FILE *gc_log = NULL;
+u_int64_t gc_statistics[GC_STATISTIC_COUNT];
+
+/* How long the gc waited for the other threads to stop. */
+static unsigned long safepoint_ms = 0;
+
+/* Returns the pause, in milliseconds. */
+static unsigned long
+account_gc(char *reason, bool full, bool promote,
+	   unsigned long real_start, unsigned long user_start,
+	   long words_before, long words_after, long weak_discarded,
+	   bool resized)
+{
+  unsigned long pause = get_real_time() - real_start;
+  unsigned long cpu = get_user_time() - user_start;
+
+  gc_statistics[GC_STAT_COLLECTIONS] += 1;
+  if (full)
+    gc_statistics[GC_STAT_FULL_COLLECTIONS] += 1;
+  if (promote)
+    gc_statistics[GC_STAT_PROMOTIONS] += 1;
+  gc_statistics[GC_STAT_PAUSE_MS] += pause;
+  if (pause > gc_statistics[GC_STAT_MAX_PAUSE_MS])
+    gc_statistics[GC_STAT_MAX_PAUSE_MS] = pause;
+  gc_statistics[GC_STAT_CPU_MS] += cpu;
+  gc_statistics[GC_STAT_BYTES_RECLAIMED] +=
+    (words_before - words_after) * sizeof(ref_t);
+  gc_statistics[GC_STAT_BYTES_SURVIVED] += words_after * sizeof(ref_t);
+  gc_statistics[GC_STAT_OBJECTS_TRANSPORTED] += transport_count;
+  gc_statistics[GC_STAT_CELLS_TRANSPORTED] += loc_transport_count;
+  gc_statistics[GC_STAT_WEAK_DISCARDED] += weak_discarded;
+  gc_statistics[GC_STAT_SAFEPOINT_MS] += safepoint_ms;
+  if (safepoint_ms > gc_statistics[GC_STAT_MAX_SAFEPOINT_MS])
+    gc_statistics[GC_STAT_MAX_SAFEPOINT_MS] = safepoint_ms;
+
+  if (gc_log)
+    {
+      fprintf(gc_log,
+	      "{\"gc\": %lu, \"reason\": \"%s\", \"full\": %s,"
+	      " \"promote\": %s, \"pause_ms\": %lu, \"cpu_ms\": %lu,"
+	      " \"bytes_before\": %lu, \"bytes_after\": %lu,"
+	      " \"objects_transported\": %lu, \"cells_transported\": %lu,"
+	      " \"weak_discarded\": %ld, \"next_newspace_bytes\": %lu,"
+	      " \"resized\": %s, \"safepoint_ms\": %lu}\n",
+	      (unsigned long)gc_statistics[GC_STAT_COLLECTIONS], reason,
+	      full ? "true" : "false", promote ? "true" : "false",
+	      pause, cpu,
+	      (unsigned long)(words_before * sizeof(ref_t)),
+	      (unsigned long)(words_after * sizeof(ref_t)),
+	      transport_count, loc_transport_count, weak_discarded,
+	      (unsigned long)(e_next_newspace_size * sizeof(ref_t)),
+	      resized ? "true" : "false", safepoint_ms);
+      fflush(gc_log);
+    }
+
+  /* Only the first collection of a call to gc() waited for it. */
+  safepoint_ms = 0;
+
+  return pause;
+}
+
+
+static void
+trace_resize(size_t old_size)
+{
+  if (e_next_newspace_size == old_size)
+    return;
+  switch (trace_gc)
+    {
+    case 0:
+      break;
+    case 1:
+      fprintf(stderr, ",resize:%ld", (long)e_next_newspace_size);
+      break;
+    default:
+      fprintf(stderr, "; Resizing next new space from %ld to %ld (%+ld%%).\n",
+	      (long)old_size, (long)e_next_newspace_size,
+	      (long)(100 * ((long)e_next_newspace_size - (long)old_size))
+	      / (long)old_size);
+      break;
+    }
+}
+
 static void
 set_external_full_gc(bool full)
 {
@@ -440,39 +1943,39 @@ gc(bool pre_dump, bool full_gc, char *reason, size_t amount)
   long old_taken;
   long old_spatic_taken;
   ref_t *p;
+  bool promote;
+  unsigned long real_start, user_start;
+  size_t previous_next_newspace_size;
+  long weak_discarded = 0;
+  bool compacted = false;
 #ifdef THREADS
-  bool ready=false;
-  int my_index;
-  int i;
-  int *my_index_p;
-  my_index_p = pthread_getspecific (index_key);
-  my_index = *my_index_p;
-  gc_ready[my_index] = 1;
-  set_gc_flag (true);
-#endif
+  int my_index = *(int *)pthread_getspecific(index_key);
 
-#ifdef THREADS
-  /*Problem here is next_index could change if someone creates a thread
-    while someone else is gc'ing*/
-   while (ready == false) {
-    ready = true;
-    for (i = 0; i < next_index; i++) {
-      if (gc_ready[i] == 0) {
-          ready = false;
-          break;
-      }
-    }
-  }
+  safepoint_ms = stop_the_world();
 #endif
 
   /* The full_gc flag is also a global to avoid ugly parameter passing. */
   set_external_full_gc(full_gc);
 
+#ifdef TLABS
+  /* Leave nothing in new space that is not a reference. */
+  FORTHREADS {
+    tlab_retire(reg_set);
+  }
+#endif
+
 gc_top:
+  real_start = get_real_time();
+  user_start = get_user_time();
+  previous_next_newspace_size = e_next_newspace_size;
+
   if (trace_gc == 1)
     fprintf(stderr, "\n;GC");
   if (trace_gc > 1)
     fprintf(stderr, "\n; %sGC due to %s.\n", full_gc ? "Full " : "", reason);
+  if (trace_gc > 1 && safepoint_ms)
+    fprintf(stderr, "; Stopping the other threads took %lu ms.\n",
+	    safepoint_ms);
 
   if (trace_gc > 2 && !pre_dump)
     {
@@ -488,17 +1991,73 @@ gc_top:
 
   old_taken = free_point - new_space.start;
   old_spatic_taken = spatic.size;
+
+#ifdef LARGE_OBJECTS
+  /* A world is dumped without the large object space, so before a dump
+     its objects are copied into the heap along with everything else. */
+  large_evacuating = pre_dump && large_object_count > 0;
+  large_begin_gc(full_gc);
+#endif
+
+  if (heap_census_file && full_gc && !pre_dump)
+    census_begin();
+
+#ifdef MARK_COMPACT
+  /* A dump writes out new space alone, so before one everything has to
+     be copied there.  Compacting would leave it in spatic space. */
+  if (full_gc && !pre_dump)
+    {
+      if (trace_gc > 1)
+	fprintf(stderr, " compacting in place...");
+      weak_discarded = compact_heap();
+      compacted = true;
+      goto compacted;
+    }
+#endif
+
   old_space = new_space;
 
   if (trace_gc > 2)
     fprintf(stderr, "old taken: %ld", old_taken);
 
-  if (full_gc)
-    new_space.size += spatic.size;
+  promote = false;
+  if (promote_next && !full_gc && !pre_dump)
+    {
+      if ((size_t) (spatic_limit - spatic.end)
+	  >= old_taken + par_slack(old_taken))
+	promote = true;
+      else if (trace_gc > 1)
+	fprintf(stderr, " no room to promote...");
+    }
+
+  if (promote)
+    {
+      if (trace_gc > 1)
+	fprintf(stderr, " promoting...");
+      new_space.start = spatic.end;
+      new_space.end = spatic_limit;
+      new_space.size = spatic_limit - spatic.end;
+    }
   else
-    new_space.size = e_next_newspace_size;
+    {
+      if (full_gc)
+	new_space.size += spatic.size;
+      else
+	new_space.size = e_next_newspace_size;
+#ifdef LARGE_OBJECTS
+      if (large_evacuating)
+	new_space.size += large_words;
+#endif
 
-  alloc_space(&new_space, new_space.size);
+      /* Leave room for the ends of chunks the workers leave unused. */
+      new_space.size += par_slack(new_space.size);
+
+      /* What is left will be spatic space, which needs room to grow. */
+      if (full_gc)
+	new_space.size += spatic_room(new_space.size);
+
+      alloc_space(&new_space, new_space.size);
+    }
   free_point = new_space.start;
 
 
@@ -556,16 +2115,29 @@ gc_top:
 	  GC_TOUCH(value_stack.segment);
 	  GC_TOUCH(context_stack.segment);
 	}
-
-	/* Scan static space. */
-	if (!full_gc)
-	  for (p = spatic.start; p < spatic.end; p++)
-	    GC_TOUCH(*p);
       }
-    /* Scavenge. */
+
+    /* Scan static space and scavenge. */
     if (trace_gc > 1)
       fprintf(stderr, " scavenging...");
-    scavenge();
+#ifdef LARGE_OBJECTS
+    if (!pre_dump && !full_gc)
+      large_cards_touch(false);
+#endif
+#ifdef PARALLEL_GC
+    if (gc_threads > 1)
+      {
+	/* Those the roots led to, which the workers do not know of. */
+	while (large_scavenge());
+	par_scavenge(false, !pre_dump && !full_gc);
+      }
+    else
+#endif
+      {
+	if (!pre_dump && !full_gc)
+	  spatic_touch();
+	scavenge();
+      }
 
     if (trace_gc > 1)
       fprintf(stderr, " %ld object%s transported.\n",
@@ -596,31 +2168,57 @@ gc_top:
 
 	    LOC_TOUCH(*p);
 	}
-
-	/* Scan spatic space. */
-	if (!full_gc)
-	  for (p = spatic.start; p < spatic.end; p++)
-	    LOC_TOUCH(*p);
       }
+
+    /* Scan spatic space and scavenge. */
     if (trace_gc > 1)
       fprintf(stderr, " scavenging...");
-    loc_scavenge();
+#ifdef LARGE_OBJECTS
+    if (!large_evacuating)
+      large_cards_touch(true);
+#endif
+#ifdef PARALLEL_GC
+    if (gc_threads > 1)
+      par_scavenge(true, !pre_dump && !full_gc);
+    else
+#endif
+      {
+	if (!pre_dump && !full_gc)
+	  spatic_loc_touch();
+	loc_scavenge();
+      }
 
     if (trace_gc > 1)
       fprintf(stderr, " %ld naked cell%s transported.\n",
 	      loc_transport_count, loc_transport_count != 1 ? "s" : "");
 
+#ifdef CARD_MARKING
+    if (!full_gc)
+      {
+	if (trace_gc > 1)
+	  fprintf(stderr, "; Scanning spatic cards...");
+	{
+	  long count = post_gc_cards();
 
-    /* Discard weak pointers whose targets have not been transported. */
-    if (trace_gc > 1)
-      fprintf(stderr, "; Scanning weak pointer table...");
-    {
-      long count = post_gc_wp();
+	  if (trace_gc > 1)
+	    fprintf(stderr, " %ld of %ld card%s still marked.\n",
+		    count, (long)spatic_card_count,
+		    spatic_card_count != 1 ? "s" : "");
+	}
+      }
+#endif
 
-      if (trace_gc > 1)
-	fprintf(stderr, " %ld entr%s discarded.\n",
-		count, count != 1 ? "ies" : "y");
-    }
+    weak_discarded = post_gc_tables();
+
+#ifdef LARGE_OBJECTS
+    if (large_evacuating)
+      {
+	large_free_all();
+	large_evacuating = false;
+      }
+    else
+      large_post_gc();
+#endif
   }
 
 #ifndef FAST
@@ -696,11 +2294,8 @@ gc_top:
 
 
 
-#ifdef USE_VADVISE
-#ifdef VA_FLUSH
-  /* Tell the virtual memory system that recent statistics are useless. */
-  vadvise(VA_FLUSH);
-#endif
+#ifdef MARK_COMPACT
+compacted:
 #endif
 
   if (trace_gc > 2 && !pre_dump)
@@ -716,7 +2311,8 @@ gc_top:
       }
     }
   {
-    long new_taken = free_point - new_space.start;
+    long new_taken =
+      free_point - new_space.start + (compacted ? spatic.size : 0);
     long old_total = old_taken + (full_gc ? old_spatic_taken : 0);
     long reclaimed = old_total - new_taken;
 
@@ -733,84 +2329,85 @@ gc_top:
 		new_taken, reclaimed, (100 * reclaimed) / old_total);
       }
 
-    /* Make the next new space bigger if the current was too small. */
-    if (!full_gc && !pre_dump
-	&& (RECLAIM_FACTOR * new_taken + amount > new_space.size))
+    /* Size the next new space by the heap policy. */
+    if (!full_gc && !pre_dump && !promote)
       {
-	e_next_newspace_size = RECLAIM_FACTOR * new_taken + amount;
-#ifdef MAX_NEW_SPACE_SIZE
-	if (e_next_newspace_size > MAX_NEW_SPACE_SIZE)
-	  e_next_newspace_size = MAX_NEW_SPACE_SIZE;
-#endif
-	switch (trace_gc)
-	  {
-	  case 0:
-	    break;
-	  case 1:
-	    fprintf(stderr, ",resize:%ld", (long)e_next_newspace_size);
-	    break;
-	  default:
-	    fprintf(stderr,
-		    "; Expanding next new space from %ld to %ld (%ld%%).\n",
-		    (long)new_space.size, (long)e_next_newspace_size,
-		    (long)(100 * (e_next_newspace_size - new_space.size))
-		    / new_space.size);
-	    break;
-	  }
+	e_next_newspace_size =
+	  next_newspace_size(new_space.size, new_taken, amount, real_start);
+	trace_resize(new_space.size);
 
 	if ((size_t) (new_space.end - free_point) < amount)
 	  {
-#ifdef MAX_NEW_SPACE_SIZE
-	    if (((new_space.end - free_point) + amount) < e_next_newspace_size)
-	      {
-		fprintf(stderr,
-			"\nFatal GC error:"
-			"Essential new space size exceeds maximum allowable.\n");
-		exit(EXIT_FAILURE);
-	      }
-#endif
+	    account_gc(reason, full_gc, promote, real_start, user_start,
+		       old_total, new_taken, weak_discarded, true);
 	    reason = "immediate new space expansion necessity";
 	    goto gc_top;
 	  }
       }
+    else if (compacted && !pre_dump)
+      {
+	e_next_newspace_size =
+	  next_newspace_size(e_next_newspace_size,
+			     free_point - new_space.start, amount,
+			     real_start);
+	trace_resize(previous_next_newspace_size);
+      }
 
-    if (full_gc && !pre_dump)
+    if (full_gc && !pre_dump && !compacted)
       {
 	/* Move _new to spatic, and reallocate new. */
 	/* (The reallocation cannot increase the size, just frees any extra.) */
 
 	spatic = new_space;
-	realloc_space(&spatic, free_point - new_space.start);
+	realloc_space(&spatic, new_taken + spatic_room(new_taken));
+	spatic_limit = spatic.end;
+	spatic.end = free_point;
+	spatic.size = new_taken;
+#ifdef CARD_MARKING
+	reset_spatic_cards();
+#endif
 
-	if (trace_gc > 1 && e_next_newspace_size != original_newspace_size)
-	  fprintf(stderr, "; Setting new space size to %ld.\n",
-		  (long)original_newspace_size);
-	new_space.size = e_next_newspace_size = original_newspace_size;
-	if (e_next_newspace_size <= amount)
-	  {
-	    e_next_newspace_size = RECLAIM_FACTOR * amount;
-	    switch (trace_gc)
-	      {
-	      case 0:
-		break;
-	      case 1:
-		fprintf(stderr, ",resize:%ld", (long)e_next_newspace_size);
-		break;
-	      default:
-		fprintf(stderr,
-			"; expanding next new space %ld to %ld (%d%%).\n",
-			(long)new_space.size,
-			(long)e_next_newspace_size,
-			(int)((100 * (e_next_newspace_size - new_space.size))
-			      / new_space.size));
-		break;
-	      }
-	    new_space.size = e_next_newspace_size;
-	  }
-	alloc_space(&new_space, new_space.size);
+	e_next_newspace_size =
+	  next_newspace_size(e_next_newspace_size, 0, amount, real_start);
+	trace_resize(previous_next_newspace_size);
+	alloc_space(&new_space, e_next_newspace_size);
+	free_point = new_space.start;
+      }
+    else if (promote)
+      {
+	/* What was transported is now part of spatic space, and refers
+	   to nothing in the new new space, which is empty. */
+	spatic.end = free_point;
+	spatic.size = spatic.end - spatic.start;
+#ifdef CARD_MARKING
+	reset_spatic_cards();
+#endif
+
+	e_next_newspace_size =
+	  next_newspace_size(e_next_newspace_size, 0, amount, real_start);
+	trace_resize(previous_next_newspace_size);
+	alloc_space(&new_space, e_next_newspace_size);
 	free_point = new_space.start;
       }
 
+    {
+      unsigned long pause =
+	account_gc(reason, full_gc, promote, real_start, user_start,
+		   old_total, new_taken, weak_discarded,
+		   e_next_newspace_size != previous_next_newspace_size);
+
+      if (!pre_dump && gc_max_pause_ms != 0)
+	{
+	  promote_next = !full_gc && !promote && 2 * pause > gc_max_pause_ms;
+	  if (trace_gc > 1)
+	    fprintf(stderr, "; Pause %lu ms%s.\n", pause,
+		    promote_next ? "; will promote next time" : "");
+	}
+    }
+
+    if (census_active)
+      census_report((unsigned long)gc_statistics[GC_STAT_COLLECTIONS]);
+
     if (trace_gc == 1)
       fprintf(stderr, "\n");
 
@@ -818,10 +2415,7 @@ gc_top:
       fflush(stdout);
   }
 #ifdef THREADS
-    my_index_p = pthread_getspecific (index_key);
-    my_index = *my_index_p;
-    gc_ready[my_index] = 0;
-    set_gc_flag (false);
+  start_the_world();
 #endif
 }
 
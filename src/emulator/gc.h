@@ -34,6 +34,45 @@ extern void printref(FILE * fd, ref_t refin);
 extern void gc(bool pre_dump, bool full_gc, char *reason,
 	       size_t amount);
 
+#ifdef CARD_MARKING
+extern void reset_spatic_cards(void);
+#endif
+
+/* For the tables outside the heap whose references the gc does not
+   trace: if *r refers to something being collected, update it to where
+   that survived and return true, or return false if it did not. */
+extern bool gc_forward(ref_t * r);
+
+extern unsigned long gc_max_pause_ms;
+
+/* The counters returned by GC-STATISTIC, in the order given by
+   gc-statistic-names in gc.oak. */
+enum
+{
+  GC_STAT_COLLECTIONS,
+  GC_STAT_FULL_COLLECTIONS,
+  GC_STAT_PROMOTIONS,
+  GC_STAT_PAUSE_MS,
+  GC_STAT_MAX_PAUSE_MS,
+  GC_STAT_CPU_MS,
+  GC_STAT_BYTES_RECLAIMED,
+  GC_STAT_BYTES_SURVIVED,
+  GC_STAT_OBJECTS_TRANSPORTED,
+  GC_STAT_CELLS_TRANSPORTED,
+  GC_STAT_WEAK_DISCARDED,
+  GC_STAT_SAFEPOINT_MS,
+  GC_STAT_MAX_SAFEPOINT_MS,
+  GC_STATISTIC_COUNT
+};
+
+extern u_int64_t gc_statistics[GC_STATISTIC_COUNT];
+extern FILE *gc_log;
+extern void alloc_spatic(size_t size);
+
+#ifdef PARALLEL_GC
+extern int gc_threads;
+#endif
+
 #define GC_MEMORY(v) \
 {*gc_examine_ptr++ = (v);}
 		/*
@@ -47,12 +86,12 @@ extern void gc(bool pre_dump, bool full_gc, char *reason,
 		   } */
 
 #ifdef THREADS
-extern int gc_ready[];
-extern bool gc_pending;
-extern pthread_mutex_t gc_lock;
+extern volatile bool gc_pending;
+extern unsigned long stop_the_world(void);
+extern void start_the_world(void);
+extern void thread_exited(void);
 #endif
 
-extern void set_gc_flag (bool flag);
 extern int get_next_index();
 extern void free_registers();
 extern void wait_for_gc();
@@ -0,0 +1,157 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "config.h"
+#include "data.h"
+#include "timers.h"
+#include "heap.h"
+
+/*
+ * The heap sizing policy.
+ *
+ * After each gc new space is sized for the next one.  It must have
+ * room for what survived, and min_free_ratio percent of it should be
+ * free.  Beyond that it grows while the gc takes more than
+ * target_gc_overhead percent of the time, measured from the end of one
+ * gc to the end of the next, and shrinks back towards the size it
+ * started with while the gc takes less than half that.  Spatic and new
+ * space together are kept within max_heap_size, which unless it is
+ * given is taken from the memory limit of the cgroup the emulator runs
+ * in, if there is one.
+ */
+
+size_t max_heap_size = 0;
+unsigned long target_gc_overhead = 5;
+unsigned long min_free_ratio = 67;
+
+/* Tenths of a percent, averaged over the last few gcs. */
+static unsigned long gc_overhead = 0;
+static unsigned long last_gc_end;
+
+/* The cgroup v2 and v1 files holding the memory limit, in bytes. */
+static const char *cgroup_limit_files[] = {
+  "/sys/fs/cgroup/memory.max",
+  "/sys/fs/cgroup/memory/memory.limit_in_bytes",
+  NULL
+};
+
+/* Returns the memory limit of our cgroup in bytes, or 0 if none. */
+static unsigned long long
+cgroup_memory_limit(void)
+{
+  const char **f;
+
+  for (f = cgroup_limit_files; *f; f++)
+    {
+      FILE *fd = fopen(*f, "r");
+      unsigned long long limit;
+      int n;
+
+      if (fd == NULL)
+	continue;
+      /* "max" in v2, a huge number in v1, if there is no limit. */
+      n = fscanf(fd, "%llu", &limit);
+      fclose(fd);
+      if (n == 1 && limit < (1ULL << 48))
+	return limit;
+      return 0;
+    }
+  return 0;
+}
+
+void
+init_heap_policy(void)
+{
+  last_gc_end = get_real_time();
+
+  if (max_heap_size == 0)
+    {
+      /* Leave half the container to the copy a gc makes and the rest
+	 of the process. */
+      unsigned long long limit = cgroup_memory_limit() / 2 / sizeof(ref_t);
+
+      if (limit > ~(size_t) 0)
+	limit = ~(size_t) 0;
+      max_heap_size = limit;
+      if (max_heap_size != 0 && trace_gc > 1)
+	fprintf(stderr, "; Limiting heap to %ld words for the cgroup.\n",
+		(long)max_heap_size);
+    }
+}
+
+/* Cut a new space size down to what the limits allow, but never below
+   needed, which is what must fit in it. */
+size_t
+heap_limit_newspace(size_t size, size_t needed)
+{
+#ifdef MAX_NEW_SPACE_SIZE
+  if (size > MAX_NEW_SPACE_SIZE)
+    size = MAX_NEW_SPACE_SIZE;
+#endif
+  if (max_heap_size != 0)
+    {
+      size_t limit =
+	max_heap_size > spatic.size ? max_heap_size - spatic.size : 0;
+
+      if (size > limit)
+	size = limit;
+    }
+  if (size < needed)
+    {
+      if (trace_gc > 1)
+	fprintf(stderr, "; Exceeding the heap limit by %ld words.\n",
+		(long)(needed - size));
+      size = needed;
+    }
+  return size;
+}
+
+/* The size the next new space should be, given that the present one
+   is size words with survivors left in it, that amount more are
+   wanted, and that the gc began at gc_start. */
+size_t
+next_newspace_size(size_t size, size_t survivors, size_t amount,
+		   unsigned long gc_start)
+{
+  unsigned long now = get_real_time();
+  unsigned long gc_time = now - gc_start;
+  unsigned long total = now - last_gc_end;
+  size_t needed = survivors * 100 / (100 - min_free_ratio) + amount;
+
+  last_gc_end = now;
+  if (total > 0)
+    gc_overhead = (3 * gc_overhead + 1000 * gc_time / total) / 4;
+
+  if (gc_overhead > 10 * target_gc_overhead)
+    size *= 2;
+  else if (2 * gc_overhead < 10 * target_gc_overhead
+	   && size > original_newspace_size)
+    {
+      size -= size / 4;
+      if (size < original_newspace_size)
+	size = original_newspace_size;
+    }
+  if (size < needed)
+    size = needed;
+
+  return heap_limit_newspace(size, survivors + amount);
+}
@@ -0,0 +1,43 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _HEAP_H_INCLUDED
+#define _HEAP_H_INCLUDED
+
+#include "config.h"
+#include "data.h"
+
+/* The policy that sizes new space, in words. */
+
+/* Most words spatic and new space together may take, or 0 if there is
+   no limit other than any the container sets. */
+extern size_t max_heap_size;
+
+/* Percentage of real time the gc should take, beyond which new space
+   grows, and below half of which it shrinks. */
+extern unsigned long target_gc_overhead;
+
+/* Percentage of new space that should be free right after a gc. */
+extern unsigned long min_free_ratio;
+
+extern void init_heap_policy(void);
+extern size_t heap_limit_newspace(size_t size, size_t needed);
+extern size_t next_newspace_size(size_t size, size_t survivors,
+				 size_t amount, unsigned long gc_start);
+
+#endif
@@ -0,0 +1,292 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "gc.h"
+#include "idhash.h"
+
+/*
+ * Identity hashes are handed out from a counter the first time an
+ * object is asked for one, and kept in open addressed hash tables keyed
+ * by the address of the object, like the predecoded code table.  Unlike
+ * weak pointers they are not kept after their objects die, so they cost
+ * nothing once the objects are gone.  Unboxed values are their own
+ * identity hashes and need no entries.
+ *
+ * As with the weak pointer hash tables, there is one table for objects
+ * in spatic space, which only a full gc touches, and one for all other
+ * objects, which every gc empties.  Entries whose objects survive are
+ * set aside and entered again, in the table for whichever area their
+ * objects ended up in, once the gc is over.
+ *
+ * The entries are saved in dumped worlds, after the weak pointer table.
+ */
+
+#define IDHASH_INITIAL_SIZE 1024	/* must be a power of two */
+#define IDHASH_MASK 0x0FFFFFFF		/* keep them positive fixnums */
+
+typedef struct
+{
+  ref_t obj;			/* 0 if the slot is empty */
+  ref_t hash;
+} idhash_entry_t;
+
+typedef struct
+{
+  idhash_entry_t *entries;
+  unsigned long mask;
+  unsigned long count;		/* slots in use */
+} idhash_table_t;
+
+static idhash_table_t idhash_spatic, idhash_young;
+
+/* Entries the last gc took out of the tables. */
+static idhash_entry_t *idhash_moved = NULL;
+static unsigned long idhash_moved_count = 0, idhash_moved_size = 0;
+
+static unsigned long next_hash = 1;
+
+#ifdef THREADS
+static pthread_mutex_t idhash_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#define IDHASH_HASH(r) \
+  ((unsigned long)((u_int32_t)(r) * 2654435769u) >> 4)
+
+
+static idhash_entry_t *
+idhash_slot(idhash_table_t * t, ref_t r)
+{
+  unsigned long i = IDHASH_HASH(r) & t->mask;
+
+  while (t->entries[i].obj != 0 && t->entries[i].obj != r)
+    i = (i + 1) & t->mask;
+  return &t->entries[i];
+}
+
+static void
+clear_idhash_table(idhash_table_t * t, unsigned long size)
+{
+  if (t->entries == NULL || t->mask + 1 != size)
+    {
+      free(t->entries);
+      t->entries =
+	(idhash_entry_t *) xmalloc(size * sizeof(idhash_entry_t));
+      t->mask = size - 1;
+    }
+  memset(t->entries, 0, size * sizeof(idhash_entry_t));
+  t->count = 0;
+}
+
+/* Enter obj with hash in the table for its area, keeping the load
+   factor under one half. */
+static void
+enter_identity_hash(ref_t obj, ref_t hash)
+{
+  idhash_table_t *t =
+    SPATIC_PTR(ANY_TO_PTR(obj)) ? &idhash_spatic : &idhash_young;
+  idhash_entry_t *e;
+
+  if (2 * (t->count + 1) > t->mask + 1)
+    {
+      idhash_entry_t *old = t->entries;
+      unsigned long i, old_size = t->mask + 1;
+
+      t->entries = NULL;
+      clear_idhash_table(t, 2 * old_size);
+      for (i = 0; i < old_size; i++)
+	if (old[i].obj != 0)
+	  {
+	    *idhash_slot(t, old[i].obj) = old[i];
+	    t->count += 1;
+	  }
+      free(old);
+    }
+
+  e = idhash_slot(t, obj);
+  if (e->obj == 0)
+    t->count += 1;
+  e->obj = obj;
+  e->hash = hash;
+}
+
+static void
+add_moved_identity_hash(ref_t obj, ref_t hash)
+{
+  if (idhash_moved_count == idhash_moved_size)
+    {
+      idhash_entry_t *old = idhash_moved;
+
+      idhash_moved_size = idhash_moved_size ? 2 * idhash_moved_size : 256;
+      idhash_moved = (idhash_entry_t *)
+	xmalloc(idhash_moved_size * sizeof(idhash_entry_t));
+      if (old)
+	{
+	  memcpy(idhash_moved, old,
+		 idhash_moved_count * sizeof(idhash_entry_t));
+	  free(old);
+	}
+    }
+  idhash_moved[idhash_moved_count].obj = obj;
+  idhash_moved[idhash_moved_count].hash = hash;
+  idhash_moved_count += 1;
+}
+
+/* Enter the entries the last gc took out of the tables. */
+static void
+settle_identity_hashes(void)
+{
+  unsigned long i;
+
+  for (i = 0; i < idhash_moved_count; i++)
+    enter_identity_hash(idhash_moved[i].obj, idhash_moved[i].hash);
+  idhash_moved_count = 0;
+}
+
+void
+init_identity_hash_tables(void)
+{
+  idhash_spatic.entries = NULL;
+  clear_idhash_table(&idhash_spatic, IDHASH_INITIAL_SIZE);
+  idhash_young.entries = NULL;
+  clear_idhash_table(&idhash_young, IDHASH_INITIAL_SIZE);
+}
+
+
+ref_t
+identity_hash(ref_t r)
+{
+  idhash_table_t *t;
+  idhash_entry_t *e;
+  ref_t hash;
+
+  if ((r & PTR_MASK) == 0)
+    return INT_TO_REF((r >> TAGSIZE) & IDHASH_MASK);
+
+#ifdef THREADS
+  pthread_mutex_lock(&idhash_lock);
+#endif
+
+  if (idhash_moved_count != 0)
+    settle_identity_hashes();
+
+  t = SPATIC_PTR(ANY_TO_PTR(r)) ? &idhash_spatic : &idhash_young;
+  e = idhash_slot(t, r);
+  if (e->obj == r)
+    hash = e->hash;
+  else
+    {
+      hash = INT_TO_REF(next_hash & IDHASH_MASK);
+      next_hash += 1;
+      enter_identity_hash(r, hash);
+    }
+
+#ifdef THREADS
+  pthread_mutex_unlock(&idhash_lock);
+#endif
+
+  return hash;
+}
+
+
+/* Move the entries of t whose objects survived to the moved list, and
+   empty it.  Returns the number of entries discarded. */
+static unsigned long
+empty_idhash_table(idhash_table_t * t)
+{
+  unsigned long i, size = t->mask + 1, discard_count = 0;
+
+  for (i = 0; i < size; i++)
+    {
+      ref_t obj = t->entries[i].obj;
+
+      if (obj == 0)
+	continue;
+      if (gc_forward(&obj))
+	add_moved_identity_hash(obj, t->entries[i].hash);
+      else
+	discard_count += 1;
+    }
+
+  clear_idhash_table(t, IDHASH_INITIAL_SIZE);
+  return discard_count;
+}
+
+unsigned long
+post_gc_identity_hash(void)
+{
+  settle_identity_hashes();
+  if (full_gc)
+    return empty_idhash_table(&idhash_spatic)
+      + empty_idhash_table(&idhash_young);
+  else
+    return empty_idhash_table(&idhash_young);
+}
+
+
+unsigned long
+identity_hash_count(void)
+{
+  return idhash_spatic.count + idhash_young.count + idhash_moved_count;
+}
+
+/* Step *i, which starts at 0, through the objects that have identity
+   hashes.  Returns false once there are no more. */
+bool
+next_identity_hash(unsigned long *i, ref_t * obj, ref_t * hash)
+{
+  unsigned long spatic_size = idhash_spatic.mask + 1;
+  unsigned long young_size = idhash_young.mask + 1;
+  idhash_entry_t *e;
+
+  for (;; *i += 1)
+    {
+      if (*i < spatic_size)
+	e = &idhash_spatic.entries[*i];
+      else if (*i < spatic_size + young_size)
+	e = &idhash_young.entries[*i - spatic_size];
+      else if (*i < spatic_size + young_size + idhash_moved_count)
+	e = &idhash_moved[*i - spatic_size - young_size];
+      else
+	return false;
+
+      if (e->obj != 0)
+	{
+	  *obj = e->obj;
+	  *hash = e->hash;
+	  *i += 1;
+	  return true;
+	}
+    }
+}
+
+/* Give obj, from a world being loaded, the identity hash it had. */
+void
+load_identity_hash(ref_t obj, ref_t hash)
+{
+  enter_identity_hash(obj, hash);
+  if ((unsigned long)REF_TO_INT(hash) >= next_hash)
+    next_hash = REF_TO_INT(hash) + 1;
+}
@@ -0,0 +1,37 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _IDHASH_H_INCLUDED
+#define _IDHASH_H_INCLUDED
+
+#include "config.h"
+#include "data.h"
+
+/* Identity hashes: fixnums that stay the same for an object for as long
+   as it lives, even as the gc moves it, and across world dumps. */
+
+extern void init_identity_hash_tables(void);
+extern ref_t identity_hash(ref_t r);
+extern unsigned long post_gc_identity_hash(void);
+
+/* For dumping and loading worlds. */
+extern unsigned long identity_hash_count(void);
+extern bool next_identity_hash(unsigned long *i, ref_t * obj, ref_t * hash);
+extern void load_identity_hash(ref_t obj, ref_t hash);
+
+#endif
@@ -0,0 +1,307 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "large.h"
+
+#ifdef LARGE_OBJECTS
+
+/*
+ * The large object space.
+ *
+ * Each large object starts a run of pages of its own, which are given
+ * back to the system when it dies.  The gc never moves them.  Like
+ * objects in new space, those allocated since the last gc are
+ * collected by the next one: it marks those it finds, and frees the
+ * others.  Those that survive are then treated like spatic space, only
+ * collected by a full gc, and their pages are cards so that between
+ * full gcs only those stored into are scanned for references to new
+ * space.
+ */
+
+#define LARGE_PAGE_SIZE (1 << LARGE_PAGE_SHIFT)
+
+/* Bits of large_state, for the first page of each object. */
+#define LARGE_YOUNG	1	/* allocated since the last gc */
+#define LARGE_MARKED	2	/* found by this gc */
+
+space_t large_space;
+u_int8_t *large_cards;
+bool large_evacuating = false;
+
+long large_object_count = 0;
+size_t large_words = 0;		/* in objects */
+
+static size_t large_page_count = 0;
+static long *large_owner;	/* first page of the object on each page, or -1 */
+static u_int32_t *large_length;	/* length of the object starting on each page */
+static u_int8_t *large_state;
+static ref_t **large_pending;	/* marked objects still to be scanned */
+static size_t large_pending_count;
+static bool large_full = false;
+
+#ifdef THREADS
+static pthread_mutex_t large_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#define LARGE_PAGES(words) (((words) + LARGE_PAGE_SIZE - 1) >> LARGE_PAGE_SHIFT)
+#define LARGE_PAGE_PTR(i) (large_space.start + ((size_t)(i) << LARGE_PAGE_SHIFT))
+
+static void
+init_large_space(void)
+{
+  size_t i;
+
+  alloc_space(&large_space, LARGE_SPACE_SIZE);
+  large_page_count = LARGE_SPACE_SIZE >> LARGE_PAGE_SHIFT;
+  large_owner = (long *)xmalloc(large_page_count * sizeof(long));
+  large_length = (u_int32_t *) xmalloc(large_page_count * sizeof(u_int32_t));
+  large_state = (u_int8_t *) xmalloc(large_page_count);
+  large_cards = (u_int8_t *) xmalloc(large_page_count);
+  large_pending = (ref_t **) xmalloc(large_page_count * sizeof(ref_t *));
+  large_pending_count = 0;
+  for (i = 0; i < large_page_count; i++)
+    large_owner[i] = -1;
+  memset(large_state, 0, large_page_count);
+  memset(large_cards, 0, large_page_count);
+}
+
+/* Returns NULL if there is no room, leaving the caller to allocate the
+   object in new space after all. */
+ref_t *
+large_alloc(long words)
+{
+  size_t n = LARGE_PAGES(words), i, run = 0;
+  ref_t *p = NULL;
+
+#ifdef THREADS
+  pthread_mutex_lock(&large_lock);
+#endif
+  if (large_space.start == NULL)
+    init_large_space();
+
+  for (i = 0; i < large_page_count; i++)
+    {
+      run = large_owner[i] < 0 ? run + 1 : 0;
+      if (run == n)
+	{
+	  size_t s = i + 1 - n, j;
+
+	  for (j = s; j <= i; j++)
+	    {
+	      large_owner[j] = s;
+	      large_cards[j] = 0;
+	    }
+	  large_length[s] = words;
+	  large_state[s] = LARGE_YOUNG;
+	  large_object_count += 1;
+	  large_words += words;
+	  p = LARGE_PAGE_PTR(s);
+	  break;
+	}
+    }
+#ifdef THREADS
+  pthread_mutex_unlock(&large_lock);
+#endif
+  return p;
+}
+
+static void
+large_free(size_t s)
+{
+  size_t j, n = LARGE_PAGES(large_length[s]);
+
+  release_space_pages(LARGE_PAGE_PTR(s), n << LARGE_PAGE_SHIFT);
+  for (j = s; j < s + n; j++)
+    {
+      large_owner[j] = -1;
+      large_cards[j] = 0;
+    }
+  large_state[s] = 0;
+  large_object_count -= 1;
+  large_words -= large_length[s];
+}
+
+/* Start a gc, which collects the young objects, or if full all of
+   them. */
+void
+large_begin_gc(bool full)
+{
+  size_t i;
+
+  large_full = full;
+  for (i = 0; i < large_page_count; i++)
+    large_state[i] &= ~LARGE_MARKED;
+  large_pending_count = 0;
+}
+
+bool
+large_collectable(ref_t * start)
+{
+  return large_full || (large_state[LARGE_PAGE(start)] & LARGE_YOUNG);
+}
+
+/* True unless p is in an object this gc is collecting and has not
+   found. */
+bool
+large_live(ref_t * p)
+{
+  long s = large_owner[LARGE_PAGE(p)];
+
+  return s >= 0 && (!large_collectable(LARGE_PAGE_PTR(s))
+		    || (large_state[s] & LARGE_MARKED));
+}
+
+/* Mark the object p is in, if this gc is collecting it.  Returns its
+   start, and its length in *len, if it was not marked before, and NULL
+   otherwise.  Its cards are all marked, as it may refer to anything. */
+ref_t *
+large_mark(ref_t * p, long *len)
+{
+  long s = large_owner[LARGE_PAGE(p)];
+  ref_t *start;
+  size_t j, n;
+
+  if (s < 0)
+    return NULL;
+  start = LARGE_PAGE_PTR(s);
+  if (!large_collectable(start))
+    return NULL;
+#ifdef PARALLEL_GC
+  if (__sync_fetch_and_or(&large_state[s], LARGE_MARKED) & LARGE_MARKED)
+    return NULL;
+#else
+  if (large_state[s] & LARGE_MARKED)
+    return NULL;
+  large_state[s] |= LARGE_MARKED;
+#endif
+
+  n = LARGE_PAGES(large_length[s]);
+  for (j = s; j < s + n; j++)
+    large_cards[j] = 1;
+  if (len)
+    *len = large_length[s];
+  return start;
+}
+
+void
+large_push_pending(ref_t * start)
+{
+  large_pending[large_pending_count++] = start;
+}
+
+ref_t *
+large_pop_pending(long *len)
+{
+  ref_t *start;
+
+  if (large_pending_count == 0)
+    return NULL;
+  start = large_pending[--large_pending_count];
+  *len = large_length[LARGE_PAGE(start)];
+  return start;
+}
+
+/* The object after p, or the first if p is NULL, with its length in
+   *len.  Returns NULL after the last. */
+ref_t *
+large_next_object(ref_t * p, long *len)
+{
+  size_t i = p ? LARGE_PAGE(p) + LARGE_PAGES(*len) : 0;
+
+  for (; i < large_page_count; i++)
+    if (large_owner[i] == (long)i)
+      {
+	*len = large_length[i];
+	return LARGE_PAGE_PTR(i);
+      }
+  return NULL;
+}
+
+/* Free the objects the gc collected and did not find, and make the
+   others old.  Returns the number freed. */
+unsigned long
+large_sweep(void)
+{
+  size_t i;
+  unsigned long count = 0;
+
+  for (i = 0; i < large_page_count; i++)
+    if (large_owner[i] == (long)i)
+      {
+	if (large_collectable(LARGE_PAGE_PTR(i))
+	    && !(large_state[i] & LARGE_MARKED))
+	  {
+	    large_free(i);
+	    count += 1;
+	  }
+	else
+	  large_state[i] = 0;
+      }
+  large_full = false;
+  return count;
+}
+
+/* After the objects have been evacuated. */
+void
+large_free_all(void)
+{
+  size_t i;
+
+  for (i = 0; i < large_page_count; i++)
+    if (large_owner[i] == (long)i)
+      large_free(i);
+  large_full = false;
+}
+
+/* Like post_gc_cards(), unmark the cards that no longer refer to new
+   space.  Returns the number left marked. */
+unsigned long
+post_gc_large_cards(void)
+{
+  size_t i;
+  unsigned long marked_count = 0;
+
+  for (i = 0; i < large_page_count; i++)
+    if (large_cards[i])
+      {
+	long s = large_owner[i];
+	ref_t *p = LARGE_PAGE_PTR(i);
+	ref_t *end = p + LARGE_PAGE_SIZE;
+
+	if (LARGE_PAGE_PTR(s) + large_length[s] < end)
+	  end = LARGE_PAGE_PTR(s) + large_length[s];
+	for (; p < end; p++)
+	  if ((*p & PTR_MASK) && NEW_PTR(ANY_TO_PTR(*p)))
+	    break;
+	if (p < end)
+	  marked_count += 1;
+	else
+	  large_cards[i] = 0;
+      }
+  return marked_count;
+}
+
+#endif
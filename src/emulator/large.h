@@ -0,0 +1,55 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _LARGE_H_INCLUDED
+#define _LARGE_H_INCLUDED
+
+#include "config.h"
+#include "data.h"
+
+#ifdef LARGE_OBJECTS
+
+/* Objects at least this many words long go in the large object space. */
+#ifndef LARGE_OBJECT_WORDS
+#define LARGE_OBJECT_WORDS 8192
+#endif
+
+/* The size of the large object space, in words.  It is only reserved,
+   not used, until objects are put there. */
+#ifndef LARGE_SPACE_SIZE
+#define LARGE_SPACE_SIZE (16 << 20)
+#endif
+
+extern long large_object_count;
+extern size_t large_words;
+
+extern ref_t *large_alloc(long words);
+extern void large_begin_gc(bool full);
+extern ref_t *large_mark(ref_t * p, long *len);
+extern void large_push_pending(ref_t * start);
+extern ref_t *large_pop_pending(long *len);
+extern ref_t *large_next_object(ref_t * p, long *len);
+extern bool large_collectable(ref_t * start);
+extern bool large_live(ref_t * p);
+extern unsigned long large_sweep(void);
+extern void large_free_all(void);
+extern unsigned long post_gc_large_cards(void);
+
+#endif
+
+#endif
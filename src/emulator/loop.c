@@ -39,10 +39,16 @@
 #include "signals.h"
 #include "timers.h"
 #include "weak.h"
+#include "idhash.h"
 #include "worldio.h"
 #include "loop.h"
 #include "cmdline.h"
 #include "xmalloc.h"
+#include "predecode.h"
+#include "mcache.h"
+#include "profile.h"
+#include "large.h"
+#include "heap.h"
 
 #ifndef FAST
 #include "instr.h"
@@ -60,7 +66,8 @@ bool trace_cxtcon = false;	/* trace contents stack contents */
 bool trace_stks = false;	/* trace contents stack contents */
 bool trace_segs = false;	/* trace stack segment manipulation */
 bool trace_meth = false;	/* trace method lookup */
-#ifdef OP_TYPE_METH_CACHE
+#if defined(OP_TYPE_METH_CACHE) || defined(CALL_SITE_CACHE) \
+    || defined(METHOD_TABLE)
 bool trace_mcache = false;	/* trace method cache hits and misses */
 #endif
 #endif
@@ -259,6 +266,9 @@ find_method_type_pair(ref_t op,
 		  *locl = cdr(alist);
 		  *loclist = alist;
 		  *pcdr(alist) = thelist;
+		  WRITE_BARRIER(locl);
+		  WRITE_BARRIER(loclist);
+		  WRITE_BARRIER(pcdr(alist));
 		}
 #endif
 	      *method_ptr = cdr(car_cache);
@@ -320,8 +330,14 @@ loop(ref_t initial_tos)
      reloading from main memory. */
 
   u_int16_t *local_epc;
+#ifdef PREDECODE
+  predecoded_code_t *local_dcode;
+#endif
 
   ref_t *local_value_sp;
+#ifdef TOS_CACHING
+  ref_t local_tos;
+#endif
   ref_t *value_stack_bp = value_stack.bp;
   ref_t *value_stack_end = &value_stack.bp[value_stack.size];
 
@@ -378,13 +394,9 @@ loop(ref_t initial_tos)
 
 #ifdef THREADS
 #define POLL_GC_SIGNALS()	if (gc_pending) {			     \
-				    value_stack.sp = local_value_sp;	     \
-				    context_stack.sp = local_context_sp;     \
-				    e_pc = local_epc;			     \
+				    UNLOCALIZE_ALL();			     \
 				    wait_for_gc();			     \
-				    local_epc = e_pc;			     \
-				    local_context_sp = context_stack.sp;     \
-				    local_value_sp = value_stack.sp;	     \
+				    LOCALIZE_ALL();			     \
 				}
 #else
 #define POLL_GC_SIGNALS()
@@ -393,13 +405,168 @@ loop(ref_t initial_tos)
 #define POLL_SIGNALS()		POLL_USER_SIGNALS() ;		\
 				POLL_TIMER_SIGNALS() ;
 
+#if ENABLE_TIMER
+#define TIMER_TICK()		timer_counter += timer_increment;
+#else
+#define TIMER_TICK()
+#endif
+
+#ifdef FAST
+#define TRACE_INSTRUCTION()
+#else
+#define TRACE_INSTRUCTION()	if (trace_insts)			\
+				  print_instr(op_field, arg_field,	\
+					      local_epc - 1);
+#endif
+
+#ifdef PROFILE_INSTRUCTIONS
+#define PROFILE_INSTRUCTION(op, arg)					\
+				if (profile_file_name)			\
+				  profile_instruction((op), (arg));
+#else
+#define PROFILE_INSTRUCTION(op, arg)
+#endif
+
+#define FETCH_RAW_INSTRUCTION()	{ instr = *local_epc++;			\
+				  op_field = (instr >> 2) & 0x3F;	\
+				  arg_field = instr >> 8;		\
+				  TRACE_INSTRUCTION();			\
+				  PROFILE_INSTRUCTION(op_field, arg_field); }
+
+#ifdef PREDECODE
+  /* If the current code vector has been predecoded, this dispatches
+     straight to the handler recorded for the instruction. */
+#define FETCH_INSTRUCTION()						\
+  { if (local_dcode)							\
+      { predecoded_instr_t *d =						\
+	  &local_dcode->instrs[local_epc++ - local_dcode->base];	\
+	op_field = d->op_field;						\
+	arg_field = d->arg_field;					\
+	TRACE_INSTRUCTION();						\
+	PROFILE_INSTRUCTION(op_field, arg_field);			\
+	goto *d->handler; }						\
+    FETCH_RAW_INSTRUCTION(); }
+
+  /* Must follow every change to e_code_segment. */
+#define ENTER_CODE_SEGMENT()						\
+  { local_dcode = predecoded_code(e_code_segment, &predecode_handlers); }
+
+#define PREDECODE_LABEL(l)	l:
+#else
+#define FETCH_INSTRUCTION()	FETCH_RAW_INSTRUCTION()
+#define ENTER_CODE_SEGMENT()
+#define PREDECODE_LABEL(l)
+#endif
+
+#define signed_arg_field ((int8_t)arg_field)
+
+  /* Superinstructions (see superinstr-loop.h) check for the
+     instructions that follow them, and take them over. */
+#define NEXT_IS_ARGLESS(n)	(local_epc[0] == ((n) << 8))
+#define NEXT_IS_ARGED(op)	((local_epc[0] & 0xFF) == ((op) << 2))
+#define TAKE_SHADOW()		{ PROFILE_INSTRUCTION((*local_epc >> 2) & 0x3F, \
+						      *local_epc >> 8);	\
+				  arg_field = *local_epc++ >> 8; }
+
+#ifdef THREADED_DISPATCH
+
+  /* Each instruction is given a label, and control passes from one
+     instruction to the next by an indirect goto through these
+     tables.  This replaces the two nested switches below, and gives
+     every instruction its own indirect branch, which branch
+     predictors handle much better than the single shared one at the
+     top of the switch. */
+
+  static void *argless_dispatch[256] = {
+	[0 ... 255] = &&argless_illegal,
+	[0] = &&argless_0, [1] = &&argless_1, [2] = &&argless_2,
+	[3] = &&argless_3, [4] = &&argless_4, [5] = &&argless_5,
+	[6] = &&argless_6, [7] = &&argless_7, [8] = &&argless_8,
+	[9] = &&argless_9, [10] = &&argless_10, [11] = &&argless_11,
+	[12] = &&argless_12, [13] = &&argless_13, [14] = &&argless_14,
+	[15] = &&argless_15, [16] = &&argless_16, [17] = &&argless_17,
+	[18] = &&argless_18, [19] = &&argless_19, [20] = &&argless_20,
+	[21] = &&argless_21, [22] = &&argless_22, [23] = &&argless_23,
+	[24] = &&argless_24, [25] = &&argless_25, [26] = &&argless_26,
+	[27] = &&argless_27, [28] = &&argless_28, [29] = &&argless_29,
+	[30] = &&argless_30, [31] = &&argless_31, [32] = &&argless_32,
+	[33] = &&argless_33, [34] = &&argless_34, [35] = &&argless_35,
+	[36] = &&argless_36, [37] = &&argless_37, [38] = &&argless_38,
+	[39] = &&argless_39, [40] = &&argless_40, [41] = &&argless_41,
+	[42] = &&argless_42, [43] = &&argless_43, [44] = &&argless_44,
+	[45] = &&argless_45, [46] = &&argless_46, [47] = &&argless_47,
+	[48] = &&argless_48, [49] = &&argless_49, [50] = &&argless_50,
+	[51] = &&argless_51, [52] = &&argless_52, [53] = &&argless_53,
+	[54] = &&argless_54, [55] = &&argless_55, [56] = &&argless_56,
+	[57] = &&argless_57, [58] = &&argless_58, [59] = &&argless_59,
+	[60] = &&argless_60, [61] = &&argless_61, [62] = &&argless_62,
+	[63] = &&argless_63, [64] = &&argless_64, [65] = &&argless_65,
+	[66] = &&argless_66, [67] = &&argless_67, [68] = &&argless_68,
+	[69] = &&argless_69, [70] = &&argless_70, [71] = &&argless_71,
+	[72] = &&argless_72, [73] = &&argless_73
+  };
+
+  static void *arged_dispatch[64] = {
+	[0 ... 63] = &&arged_illegal,
+	[1] = &&arged_1, [2] = &&arged_2, [3] = &&arged_3,
+	[4] = &&arged_4, [5] = &&arged_5, [6] = &&arged_6,
+	[7] = &&arged_7, [8] = &&arged_8, [9] = &&arged_9,
+	[10] = &&arged_10, [11] = &&arged_11, [12] = &&arged_12,
+	[13] = &&arged_13, [14] = &&arged_14, [15] = &&arged_15,
+	[16] = &&arged_16, [17] = &&arged_17, [18] = &&arged_18,
+	[19] = &&arged_19, [20] = &&arged_20, [21] = &&arged_21,
+	[22] = &&arged_22, [23] = &&arged_23, [24] = &&arged_24,
+	[25] = &&arged_25, [26] = &&arged_26, [27] = &&arged_27,
+	[28] = &&arged_28, [29] = &&arged_29, [30] = &&arged_30,
+	[31] = &&arged_31, [32] = &&arged_32, [33] = &&arged_33,
+	[34] = &&arged_34,
+#define SUPERINSTR_DISPATCH
+#include "superinstr-loop.h"
+#undef SUPERINSTR_DISPATCH
+  };
+
+#ifdef PREDECODE
+  static const predecode_handlers_t predecode_handlers = {
+	argless_dispatch, arged_dispatch,
+	&&load_imm_aligned, &&load_imm_con_aligned
+  };
+#endif
+
+#define ARGLESS_CASE(n)		case n: argless_##n
+#define ARGED_CASE(n)		case n: arged_##n
+#define DISPATCH_LABEL(l)	l:
+
+#define DISPATCH()		goto *(op_field == 0			\
+				       ? argless_dispatch[arg_field]	\
+				       : arged_dispatch[op_field]);
+
+#else
+
+#define ARGLESS_CASE(n)		case n
+#define ARGED_CASE(n)		case n
+#define DISPATCH_LABEL(l)
+#define DISPATCH()
+
+#endif
+
   /* This is the big instruction fetch/execute loop. */
 
   enable_signal_polling();
 
+  ENTER_CODE_SEGMENT();
+
+#if defined(THREADED_DISPATCH) && defined(FAST)
+  /* Replicate the instruction fetch at the end of every instruction
+     rather than branching back to a shared one. */
+#define GOTO_TOP	{ POLL_GC_SIGNALS();				\
+			  TIMER_TICK();					\
+			  FETCH_INSTRUCTION();				\
+			  DISPATCH(); }
+#else
 #define GOTO_TOP	goto top_of_loop;
 
  top_of_loop:
+#endif
   while (1)			/* forever */
     {
 #ifndef FAST
@@ -435,20 +602,11 @@ loop(ref_t initial_tos)
 
       POLL_GC_SIGNALS();
 
-#if ENABLE_TIMER
-      timer_counter += timer_increment;
-#endif
-
-      instr = *local_epc++;
+      TIMER_TICK();
 
-      op_field = (instr >> 2) & 0x3F;
-      arg_field = instr >> 8;
-#define signed_arg_field ((int8_t)arg_field)
+      FETCH_INSTRUCTION();
 
-#ifndef FAST
-      if (trace_insts)
-	print_instr(op_field, arg_field, local_epc - 1);
-#endif
+      DISPATCH();
 
       /*
 	fprintf(stdout, "Asserting...\n");
@@ -463,10 +621,10 @@ loop(ref_t initial_tos)
 	  switch (arg_field)
 	    {
 
-	    case 0:		/* NOOP */
+	    ARGLESS_CASE(0):		/* NOOP */
 	      GOTO_TOP;
 
-	    case 1:		/* PLUS */
+	    ARGLESS_CASE(1):		/* PLUS */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -477,7 +635,7 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 2:		/* NEGATE */
+	    ARGLESS_CASE(2):		/* NEGATE */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      /* The most negative fixnum's negation isn't a fixnum. */
@@ -487,17 +645,17 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = -((long)x);
 	      GOTO_TOP;
 
-	    case 3:		/* EQ? */
+	    ARGLESS_CASE(3):		/* EQ? */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      PEEKVAL() = BOOL_TO_REF(x == y);
 	      GOTO_TOP;
 
-	    case 4:		/* NOT */
+	    ARGLESS_CASE(4):		/* NOT */
 	      PEEKVAL() = BOOL_TO_REF(PEEKVAL() == e_false);
 	      GOTO_TOP;
 
-	    case 5:		/* TIMES */
+	    ARGLESS_CASE(5):		/* TIMES */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -554,18 +712,19 @@ loop(ref_t initial_tos)
 #endif
 	      GOTO_TOP;
 
-	    case 6:		/* LOAD-IMM ; INLINE-REF */
+	    ARGLESS_CASE(6):		/* LOAD-IMM ; INLINE-REF */
 	      /* align pc to next word boundary: */
 
 	      if ((unsigned long)local_epc & 0x2)
 		local_epc++;
+	    PREDECODE_LABEL(load_imm_aligned)
 	      /*NOSTRICT */
 	      x = *(ref_t *)local_epc;
 	      PUSHVAL(x);
 	      local_epc += sizeof(ref_t) / sizeof(*local_epc);
 	      GOTO_TOP;
 
-	    case 7:		/* DIV */
+	    ARGLESS_CASE(7):		/* DIV */
 	      /* Sign of product of args. */
 	      /* Round towards 0.  Obeys identity w/ REMAINDER. */
 	      POPVAL(x);
@@ -579,17 +738,17 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = INT_TO_REF((long)x / (long)y);
 	      GOTO_TOP;
 
-	    case 8:		/* =0? */
+	    ARGLESS_CASE(8):		/* =0? */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      PEEKVAL() = BOOL_TO_REF(x == INT_TO_REF(0));
 	      GOTO_TOP;
 
-	    case 9:		/* GET-TAG */
+	    ARGLESS_CASE(9):		/* GET-TAG */
 	      PEEKVAL() = INT_TO_REF(PEEKVAL() & TAG_MASK);
 	      GOTO_TOP;
 
-	    case 10:		/* GET-DATA */
+	    ARGLESS_CASE(10):		/* GET-DATA */
 
 	      /* With the moving gc, this should *NEVER* be used.
 
@@ -618,7 +777,7 @@ loop(ref_t initial_tos)
 		PEEKVAL() = (x & ~TAG_MASKL) | INT_TAG;
 	      GOTO_TOP;
 
-	    case 11:		/* CRUNCH */
+	    ARGLESS_CASE(11):		/* CRUNCH */
 	      POPVAL(x);	/* data */
 	      y = PEEKVAL();	/* tag */
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -648,12 +807,12 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 12:		/* GETC */
+	    ARGLESS_CASE(12):		/* GETC */
 	      /* Used in emergency cold load standard-input stream. */
 	      PUSHVAL_IMM(CHAR_TO_REF(getc(stdin)));
 	      GOTO_TOP;
 
-	    case 13:		/* PUTC */
+	    ARGLESS_CASE(13):		/* PUTC */
 	      /* Used in emergency cold load standard-output stream and
 	         for the warm boot message. */
 	      x = PEEKVAL();
@@ -667,23 +826,24 @@ loop(ref_t initial_tos)
 #endif
 	      GOTO_TOP;
 
-	    case 14:		/* CONTENTS */
+	    ARGLESS_CASE(14):		/* CONTENTS */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, LOC_TAG, 1);
 	      PEEKVAL() = *LOC_TO_PTR(x);
 	      GOTO_TOP;
 
-	    case 15:		/* SET-CONTENTS */
+	    ARGLESS_CASE(15):		/* SET-CONTENTS */
 	      POPVAL(x);
 	      CHECKTAG1(x, LOC_TAG, 2);
 	      *LOC_TO_PTR(x) = PEEKVAL();
+	      WRITE_BARRIER(LOC_TO_PTR(x));
 	      GOTO_TOP;
 
-	    case 16:		/* LOAD-TYPE */
+	    ARGLESS_CASE(16):		/* LOAD-TYPE */
 	      PEEKVAL() = get_type(PEEKVAL());
 	      GOTO_TOP;
 
-	    case 17:		/* CONS */
+	    ARGLESS_CASE(17):		/* CONS */
 	      {
 		ref_t *p;
 
@@ -698,7 +858,7 @@ loop(ref_t initial_tos)
 		GOTO_TOP;
 	      }
 
-	    case 18:		/* <0? */
+	    ARGLESS_CASE(18):		/* <0? */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      /* Tag trickery: */
@@ -706,7 +866,7 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = BOOL_TO_REF((int32_t)x < 0);
 	      GOTO_TOP;
 
-	    case 19:		/* MODULO */
+	    ARGLESS_CASE(19):		/* MODULO */
 	      /* Sign of divisor (thing being divided by). */
 	      POPVAL(x);
 	      y = PEEKVAL();
@@ -722,7 +882,7 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 20:		/* ASH */
+	    ARGLESS_CASE(20):		/* ASH */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -741,7 +901,7 @@ loop(ref_t initial_tos)
 		  }
 	      }
 
-	    case 21:		/* ROT */
+	    ARGLESS_CASE(21):		/* ROT */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -766,23 +926,25 @@ loop(ref_t initial_tos)
 		  }
 	      }
 
-	    case 22:		/* STORE-BP-I */
+	    ARGLESS_CASE(22):		/* STORE-BP-I */
 	      POPVAL(x);
 	      CHECKTAG1(x, INT_TAG, 2);
 	      *(e_bp + REF_TO_INT(x)) = PEEKVAL();
+	      WRITE_BARRIER(e_bp + REF_TO_INT(x));
 	      GOTO_TOP;
 
-	    case 23:		/* LOAD-BP-I */
+	    ARGLESS_CASE(23):		/* LOAD-BP-I */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      PEEKVAL() = *(e_bp + REF_TO_INT(x));
 	      GOTO_TOP;
 
-	    case 24:		/* RETURN */
+	    ARGLESS_CASE(24):		/* RETURN */
 	      POP_CONTEXT();
+	      ENTER_CODE_SEGMENT();
 	      GOTO_TOP;
 
-	    case 25:		/* ALLOCATE */
+	    ARGLESS_CASE(25):		/* ALLOCATE */
 	      {
 		ref_t *p;
 
@@ -790,6 +952,8 @@ loop(ref_t initial_tos)
 		y = PEEKVAL();
 		CHECKTAG1(y, INT_TAG, 2);
 
+		ref_t *end;
+
 		ALLOCATE1(p, REF_TO_INT(y),
 			  "space crunch in ALLOCATE instruction", x);
 
@@ -797,17 +961,17 @@ loop(ref_t initial_tos)
 
 		PEEKVAL() = PTR_TO_REF(p);
 
-		while (++p < free_point)
+		for (end = p + REF_TO_INT(y); ++p < end;)
 		  *p = NEW_STORAGE;
 		GOTO_TOP;
 	      }
 
-	    case 26:		/* ASSQ */
+	    ARGLESS_CASE(26):		/* ASSQ */
 	      POPVAL(x);
 	      PEEKVAL() = assq(x, PEEKVAL(), e_false);
 	      GOTO_TOP;
 
-	    case 27:		/* LOAD-LENGTH */
+	    ARGLESS_CASE(27):		/* LOAD-LENGTH */
 	      x = PEEKVAL();
 	      PEEKVAL() =
 		(TAG_IS(x, PTR_TAG) ?
@@ -817,16 +981,17 @@ loop(ref_t initial_tos)
 		 INT_TO_REF(0));
 	      GOTO_TOP;
 
-	    case 28:		/* PEEK */
+	    ARGLESS_CASE(28):		/* PEEK */
 	      PEEKVAL() = INT_TO_REF(*(u_int16_t *) PEEKVAL());
 	      GOTO_TOP;
 
-	    case 29:		/* POKE */
+	    ARGLESS_CASE(29):		/* POKE */
 	      POPVAL(x);
 	      *(u_int16_t *) x = (u_int16_t) REF_TO_INT(PEEKVAL());
+	      WRITE_BARRIER(ANY_TO_PTR(x));
 	      GOTO_TOP;
 
-	    case 30:		/* MAKE-CELL */
+	    ARGLESS_CASE(30):		/* MAKE-CELL */
 	      {
 		ref_t *p;
 
@@ -837,7 +1002,7 @@ loop(ref_t initial_tos)
 		GOTO_TOP;
 	      }
 
-	    case 31:		/* SUBTRACT */
+	    ARGLESS_CASE(31):		/* SUBTRACT */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -850,7 +1015,7 @@ loop(ref_t initial_tos)
 	      }
 
 
-	    case 32:		/* = */
+	    ARGLESS_CASE(32):		/* = */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -858,7 +1023,7 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = BOOL_TO_REF(x == y);
 	      GOTO_TOP;
 
-	    case 33:		/* < */
+	    ARGLESS_CASE(33):		/* < */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -866,19 +1031,19 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = BOOL_TO_REF((long)x < (long)y);
 	      GOTO_TOP;
 
-	    case 34:		/* LOG-NOT */
+	    ARGLESS_CASE(34):		/* LOG-NOT */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      /* Tag trickery: */
 	      PEEKVAL() = ~x - (TAG_MASK - INT_TAG);
 	      GOTO_TOP;
 
-	    case 35:		/* LONG-BRANCH distance (signed) */
+	    ARGLESS_CASE(35):		/* LONG-BRANCH distance (signed) */
 	      POLL_SIGNALS();
 	      local_epc += ASHR2(SIGN_16BIT_ARG(*local_epc)) + 1;
 	      GOTO_TOP;
 
-	    case 36:		/* LONG-BRANCH-NIL distance (signed) */
+	    ARGLESS_CASE(36):		/* LONG-BRANCH-NIL distance (signed) */
 	      POLL_SIGNALS();
 	      POPVAL(x);
 	      if (x != e_nil)
@@ -887,7 +1052,7 @@ loop(ref_t initial_tos)
 		local_epc += ASHR2(SIGN_16BIT_ARG(*local_epc)) + 1;
 	      GOTO_TOP;
 
-	    case 37:		/* LONG-BRANCH-T distance (signed) */
+	    ARGLESS_CASE(37):		/* LONG-BRANCH-T distance (signed) */
 	      POLL_SIGNALS();
 	      POPVAL(x);
 	      if (x == e_nil)
@@ -896,13 +1061,13 @@ loop(ref_t initial_tos)
 		local_epc += ASHR2(SIGN_16BIT_ARG(*local_epc)) + 1;
 	      GOTO_TOP;
 
-	    case 38:		/* LOCATE-BP-I */
+	    ARGLESS_CASE(38):		/* LOCATE-BP-I */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      PEEKVAL() = PTR_TO_LOC(e_bp + REF_TO_INT(x));
 	      GOTO_TOP;
 
-	    case 39:		/* LOAD-IMM-CON ; INLINE-REF */
+	    ARGLESS_CASE(39):		/* LOAD-IMM-CON ; INLINE-REF */
 	      /* This is like a LOAD-IMM followed by a CONTENTS. */
 	      /* align pc to next word boundary: */
 
@@ -911,6 +1076,7 @@ loop(ref_t initial_tos)
 	      /* Do it in ?three? instructions including branch: */
 	      if ((unsigned long)local_epc & 2)
 		local_epc++;
+	    PREDECODE_LABEL(load_imm_con_aligned)
 
 	      /* NOSTRICT */
 	      x = *(ref_t *) local_epc;
@@ -930,50 +1096,52 @@ loop(ref_t initial_tos)
 		  CHECKTAG0(x, PTR_TAG, a);			\
 		  if (REF_SLOT(x,0) != e_cons_type) { TRAP0(a); } }
 
-	    case 40:		/* CAR */
+	    ARGLESS_CASE(40):		/* CAR */
 	      CONSINSTR(1);
 	      PEEKVAL() = car(x);
 	      GOTO_TOP;
 
-	    case 41:		/* CDR */
+	    ARGLESS_CASE(41):		/* CDR */
 	      CONSINSTR(1);
 	      PEEKVAL() = cdr(x);
 	      GOTO_TOP;
 
-	    case 42:		/* SET-CAR */
+	    ARGLESS_CASE(42):		/* SET-CAR */
 	      CONSINSTR(2);
 	      POPVALS(1);
 	      *pcar(x) = PEEKVAL();
+	      WRITE_BARRIER(pcar(x));
 	      GOTO_TOP;
 
-	    case 43:		/* SET-CDR */
+	    ARGLESS_CASE(43):		/* SET-CDR */
 	      CONSINSTR(2);
 	      POPVALS(1);
 	      *pcdr(x) = PEEKVAL();
+	      WRITE_BARRIER(pcdr(x));
 	      GOTO_TOP;
 
-	    case 44:		/* LOCATE-CAR */
+	    ARGLESS_CASE(44):		/* LOCATE-CAR */
 	      CONSINSTR(1);
 	      PEEKVAL() = PTR_TO_LOC(pcar(x));
 	      GOTO_TOP;
 
-	    case 45:		/* LOCATE-CDR */
+	    ARGLESS_CASE(45):		/* LOCATE-CDR */
 	      CONSINSTR(1);
 	      PEEKVAL() = PTR_TO_LOC(pcdr(x));
 	      GOTO_TOP;
 
 	      /* Done with cons access instructions. */
 
-	    case 46:		/* PUSH-CXT-LONG rel */
+	    ARGLESS_CASE(46):		/* PUSH-CXT-LONG rel */
 	      PUSH_CONTEXT(ASHR2(SIGN_16BIT_ARG(*local_epc)) + 1);
 	      local_epc++;
 	      GOTO_TOP;
 
-	    case 47:		/* Call a primitive routine. */
+	    ARGLESS_CASE(47):		/* Call a primitive routine. */
 	      fprintf(stderr, "Not configured for CALL-PRIMITIVE.\n");
 	      GOTO_TOP;
 
-	    case 48:		/* THROW */
+	    ARGLESS_CASE(48):		/* THROW */
 	      POPVAL(x);
 	      CHECKTAG1(x, PTR_TAG, 2);
 	      y = PEEKVAL();
@@ -981,52 +1149,61 @@ loop(ref_t initial_tos)
 	      BASH_CXT_HEIGHT(REF_TO_INT(REF_SLOT(x, ESCAPE_OBJECT_CXT_OFF)));
 	      PUSHVAL(y);
 	      POP_CONTEXT();
+	      ENTER_CODE_SEGMENT();
 	      GOTO_TOP;
 
-	    case 49:		/* GET-WP */
+	    ARGLESS_CASE(49):		/* GET-WP */
 	      PEEKVAL() = ref_to_wp(PEEKVAL());
 	      GOTO_TOP;
 
-	    case 50:		/* WP-CONTENTS */
+	    ARGLESS_CASE(50):		/* WP-CONTENTS */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, INT_TAG, 1);
 	      PEEKVAL() = wp_to_ref(x);
 	      GOTO_TOP;
 
-	    case 51:		/* GC */
+	    ARGLESS_CASE(51):		/* GC */
 	      UNLOCALIZE_ALL();
 	      gc(false, false, "explicit call", 0);
 	      LOCALIZE_ALL();
 	      PUSHVAL(e_false);
 	      GOTO_TOP;
 
-	    case 52:		/* BIG-ENDIAN? */
+	    ARGLESS_CASE(52):		/* BIG-ENDIAN? */
 	      x = BOOL_TO_REF(__BYTE_ORDER == __BIG_ENDIAN);
 	      PUSHVAL(x);
 	      GOTO_TOP;
 
-	    case 53:		/* VLEN-ALLOCATE */
+	    ARGLESS_CASE(53):		/* VLEN-ALLOCATE */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAG1(y, INT_TAG, 2);
 	      {
-		ref_t *p;
+		ref_t *p, *end;
 
-		ALLOCATE1(p, REF_TO_INT(y),
-			  "space crunch in VARLEN-ALLOCATE instruction", x);
+#ifdef LARGE_OBJECTS
+		if (REF_TO_INT(y) >= LARGE_OBJECT_WORDS
+		    && (p = large_alloc(REF_TO_INT(y))) != NULL)
+		  ALLOCATION_SAMPLE(REF_TO_INT(y), UNLOCALIZE_REGS(),
+				    LOCALIZE_REGS())
+		else
+#endif
+		  ALLOCATE1(p, REF_TO_INT(y),
+			    "space crunch in VARLEN-ALLOCATE instruction", x);
 
 		PEEKVAL() = PTR_TO_REF(p);
 
 		p[0] = x;
 		p[1] = y;
+		end = p + REF_TO_INT(y);
 		p += 2;
 
-		while (p < free_point)
+		while (p < end)
 		  *p++ = NEW_STORAGE;
 	      }
 	      GOTO_TOP;
 
-	    case 54:		/* INC-LOC */
+	    ARGLESS_CASE(54):		/* INC-LOC */
 	      /* Increment a locative by an amount.  This is an instruction
 	         rather than (%crunch (+ (%pointer loc) index) %locative-tag)
 	         to avoid a window of gc vulnerability.  All such windows
@@ -1037,7 +1214,7 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = PTR_TO_LOC(LOC_TO_PTR(x) + REF_TO_INT(y));
 	      GOTO_TOP;
 
-	    case 55:		/* FILL-CONTINUATION */
+	    ARGLESS_CASE(55):		/* FILL-CONTINUATION */
 	      /* This instruction fills a continuation object with
 	         the appropriate values. */
 	      CHECKVAL_POP(1);
@@ -1060,12 +1237,14 @@ loop(ref_t initial_tos)
 		= context_stack.segment;
 	      REF_SLOT(x, CONTINUATION_CXT_OFF)
 		= INT_TO_REF(context_stack.pushed_count);
+	      WRITE_BARRIER(&REF_SLOT(x, CONTINUATION_VAL_SEGS));
+	      WRITE_BARRIER(&REF_SLOT(x, CONTINUATION_CXT_SEGS));
 	      /* Maybe it's a good idea to reload the buffer, but I'm
 	         not bothering and things seem to work. */
 	      /* CHECKCXT_POP(0); */
 	      GOTO_TOP;
 
-	    case 56:		/* CONTINUE */
+	    ARGLESS_CASE(56):		/* CONTINUE */
 	      /* Continue a continuation. */
 	      /* Grab the continuation. */
 
@@ -1079,8 +1258,7 @@ loop(ref_t initial_tos)
 	      value_stack.pushed_count
 		= REF_TO_INT(REF_SLOT(x, CONTINUATION_VAL_OFF));
 
-	      local_value_sp = &value_stack_bp[-1];
-	      PUSHVAL_NOCHECK(y);
+	      RESET_VALUE_STACK(y);
 
 	      context_stack.segment
 		= REF_SLOT(x, CONTINUATION_CXT_SEGS);
@@ -1088,9 +1266,10 @@ loop(ref_t initial_tos)
 		= REF_TO_INT(REF_SLOT(x, CONTINUATION_CXT_OFF));
 	      local_context_sp = &context_stack_bp[-1];
 	      POP_CONTEXT();
+	      ENTER_CODE_SEGMENT();
 	      GOTO_TOP;
 
-	    case 57:		/* REVERSE-CONS */
+	    ARGLESS_CASE(57):		/* REVERSE-CONS */
 	      /* This is just like CONS except that it takes its args
 	         in the other order.  Makes open coded LIST better. */
 
@@ -1109,11 +1288,11 @@ loop(ref_t initial_tos)
 	      }
 
 
-	    case 58:		/* MOST-NEGATIVE-FIXNUM? */
+	    ARGLESS_CASE(58):		/* MOST-NEGATIVE-FIXNUM? */
 	      PEEKVAL() = BOOL_TO_REF( PEEKVAL() == MIN_REF );
 	      GOTO_TOP;
 
-	    case 59:		/* FX-PLUS */
+	    ARGLESS_CASE(59):		/* FX-PLUS */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -1121,7 +1300,7 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = x + y;
 	      GOTO_TOP;
 
-	    case 60:		/* FX-TIMES */
+	    ARGLESS_CASE(60):		/* FX-TIMES */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
@@ -1129,12 +1308,12 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = REF_TO_INT(x) * y;
 	      GOTO_TOP;
 
-	    case 61:		/* GET-TIME */
+	    ARGLESS_CASE(61):		/* GET-TIME */
 	      /* Return CPU time */
 	      PUSHVAL_IMM(INT_TO_REF(get_user_time()));
 	      GOTO_TOP;
 
-	    case 62:		/* REMAINDER */
+	    ARGLESS_CASE(62):		/* REMAINDER */
 	      /* Sign of dividend (thing being divided.) */
 	      POPVAL(x);
 	      y = PEEKVAL();
@@ -1144,7 +1323,7 @@ loop(ref_t initial_tos)
 	      PEEKVAL() = INT_TO_REF(REF_TO_INT(x) % REF_TO_INT(y));
 	      GOTO_TOP;
 
-	    case 63:		/* QUOTIENTM */
+	    ARGLESS_CASE(63):		/* QUOTIENTM */
 	      /* Round towards -inf.  Obeys identity w/ MODULO. */
 	      POPVAL(x);
 	      y = PEEKVAL();
@@ -1169,14 +1348,14 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 64:		/* FULL-GC */
+	    ARGLESS_CASE(64):		/* FULL-GC */
 	      UNLOCALIZE_ALL();
 	      gc(false, true, "explicit call", 0);
 	      LOCALIZE_ALL();
 	      PUSHVAL(e_false);
 	      GOTO_TOP;
 
-	    case 65:		/* MAKE-LAMBDA */
+	    ARGLESS_CASE(65):		/* MAKE-LAMBDA */
 	      {
 		ref_t *p;
 
@@ -1197,7 +1376,7 @@ loop(ref_t initial_tos)
 		GOTO_TOP;
 	      }
 
-	    case 66:		/* GET-ARGLINE-CHAR */
+	    ARGLESS_CASE(66):		/* GET-ARGLINE-CHAR */
 	      /* takes two args on stack, index into argv and index into
 	         that argument.  Return a character (perhaps nul), or
 	         #f if out of bounds */
@@ -1210,22 +1389,22 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 67:		/* ENABLE-ALARMS */
+	    ARGLESS_CASE(67):		/* ENABLE-ALARMS */
 	      timer_increment = 1;
 	      PUSHVAL(e_nil);
 	      GOTO_TOP;
 
-	    case 68:		/* DISABLE-ALARMS */
+	    ARGLESS_CASE(68):		/* DISABLE-ALARMS */
 	      timer_increment = 0;
 	      PUSHVAL(e_nil);
 	      GOTO_TOP;
 
-	    case 69:		/* RESET-ALARM-COUNTER */
+	    ARGLESS_CASE(69):		/* RESET-ALARM-COUNTER */
 	      timer_counter = 0;
 	      PUSHVAL(e_nil);
 	      GOTO_TOP;
 
-	    case 70:		/* HEAVYWEIGHT-THREAD */
+	    ARGLESS_CASE(70):		/* HEAVYWEIGHT-THREAD */
 #ifdef THREADS
 	      PEEKVAL() = BOOL_TO_REF( create_thread(PEEKVAL()) );
 #else
@@ -1233,7 +1412,7 @@ loop(ref_t initial_tos)
 #endif
 	      GOTO_TOP;
 
-	    case 71:		/* TEST-AND-SET-LOCATIVE */
+	    ARGLESS_CASE(71):		/* TEST-AND-SET-LOCATIVE */
 	      POPVAL(x);
 	      CHECKTAG1(x, LOC_TAG, 2);
 	      POPVAL(y);
@@ -1248,12 +1427,13 @@ loop(ref_t initial_tos)
 		GOTO_TOP;
 	      }
 	      /* Start Critical Section. */
-	      if (*(volatile ref *)LOC_TO_PTR(x) != y) {
+	      if (*(volatile ref_t *)LOC_TO_PTR(x) != y) {
 		// fail
 		PEEKVAL() = e_false;
 	      } else {
 		// succeed
 		*LOC_TO_PTR(x) = PEEKVAL();
+		WRITE_BARRIER(LOC_TO_PTR(x));
 		PEEKVAL() = e_t;
 	      }
 	      pthread_mutex_unlock(&test_and_set_locative_lock);
@@ -1261,13 +1441,34 @@ loop(ref_t initial_tos)
 	      GOTO_TOP;
 #else
 	      *LOC_TO_PTR(x) = PEEKVAL();
+	      WRITE_BARRIER(LOC_TO_PTR(x));
 	      PEEKVAL() = e_t;
 	      GOTO_TOP;
 #endif
 
+	    ARGLESS_CASE(72):		/* GC-STATISTIC */
+	      /* Return bits shift and up of a gc counter, as a fixnum of
+	         at most 28 bits, or #f if there is no such counter. */
+	      POPVAL(x);
+	      y = PEEKVAL();
+	      CHECKTAGS_INT_1(x, y, 2);
+	      if ((unsigned long)REF_TO_INT(x) >= GC_STATISTIC_COUNT
+		  || (unsigned long)REF_TO_INT(y) >= 64)
+		PEEKVAL() = e_false;
+	      else
+		PEEKVAL() =
+		  INT_TO_REF((gc_statistics[REF_TO_INT(x)] >> REF_TO_INT(y))
+			     & 0x0FFFFFFF);
+	      GOTO_TOP;
 
-#ifndef FAST
+	    ARGLESS_CASE(73):		/* IDENTITY-HASH */
+	      PEEKVAL() = identity_hash(PEEKVAL());
+	      GOTO_TOP;
+
+
+#if !defined(FAST) || defined(THREADED_DISPATCH)
 	    default:
+	    DISPATCH_LABEL(argless_illegal)
 	      printf("\nError (vm interpreter): "
 		     "Illegal argless instruction %d.\n", arg_field);
 	      UNLOCALIZE_ALL();
@@ -1289,7 +1490,7 @@ loop(ref_t initial_tos)
 		      "file: %s line: %d\n", __FILE__, __LINE__);
 	      exit(EXIT_FAILURE);
 #endif
-	    case 1:		/* HALT n */
+	    ARGED_CASE(1):		/* HALT n */
 	      {
 		int halt_code = arg_field;
 
@@ -1298,23 +1499,24 @@ loop(ref_t initial_tos)
 		exit(halt_code);
 	      }
 
-	    case 2:		/* LOG-OP log-spec */
+	    ARGED_CASE(2):		/* LOG-OP log-spec */
 	      POPVAL(x);
 	      y = PEEKVAL();
 	      CHECKTAGS_INT_1(x, y, 2);
 	      /* Tag trickery: */
-	      PEEKVAL() = ((instr & (1 << 8) ? x & y : 0)
-			   | (instr & (1 << 9) ? ~x & y : 0)
-			   | (instr & (1 << 10) ? x & ~y : 0)
-			   | (instr & (1 << 11) ? ~x & ~y : 0)) & ~TAG_MASKL;
+	      PEEKVAL() = ((arg_field & (1 << 0) ? x & y : 0)
+			   | (arg_field & (1 << 1) ? ~x & y : 0)
+			   | (arg_field & (1 << 2) ? x & ~y : 0)
+			   | (arg_field & (1 << 3) ? ~x & ~y : 0)) & ~TAG_MASKL;
 	      GOTO_TOP;
 
-	    case 3:		/* BLT-STACK stuff,trash */
+	    ARGED_CASE(3):		/* BLT-STACK stuff,trash */
 	      {
 		unsigned int stuff = arg_field & 0xf;
 		unsigned int trash_m1 = arg_field >> 4;
 
 		CHECKVAL_POP(stuff + trash_m1);
+		SPILL_TOS();
 
 		{
 		  ref_t *src = local_value_sp - stuff;
@@ -1325,10 +1527,11 @@ loop(ref_t initial_tos)
 
 		  local_value_sp = dest;
 		}
+		FILL_TOS();
 	      }
 	      GOTO_TOP;
 
-	    case 4:		/* BRANCH-NIL distance (signed) */
+	    ARGED_CASE(4):		/* BRANCH-NIL distance (signed) */
 
 	      POLL_SIGNALS();
 
@@ -1337,7 +1540,7 @@ loop(ref_t initial_tos)
 		local_epc += signed_arg_field;
 	      GOTO_TOP;
 
-	    case 5:		/* BRANCH-T distance (signed) */
+	    ARGED_CASE(5):		/* BRANCH-T distance (signed) */
 
 	      POLL_SIGNALS();
 
@@ -1346,18 +1549,18 @@ loop(ref_t initial_tos)
 		local_epc += signed_arg_field;
 	      GOTO_TOP;
 
-	    case 6:		/* BRANCH distance (signed) */
+	    ARGED_CASE(6):		/* BRANCH distance (signed) */
 
 	      POLL_SIGNALS();
 
 	      local_epc += signed_arg_field;
 	      GOTO_TOP;
 
-	    case 7:		/* POP n */
+	    ARGED_CASE(7):		/* POP n */
 	      POPVALS(arg_field);
 	      GOTO_TOP;
 
-	    case 8:		/* SWAP n */
+	    ARGED_CASE(8):		/* SWAP n */
 	      x = PEEKVAL();
 	      {
 		ref_t *other;
@@ -1367,22 +1570,23 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 9:		/* BLAST n */
+	    ARGED_CASE(9):		/* BLAST n */
 	      CHECKVAL_POP(arg_field);
 	      {
 		ref_t *other = local_value_sp - arg_field;
 		*other = POPVAL_NOCHECK();
 	      }
+	      /* BLAST 1 stores into the new top of stack. */
+	      FILL_TOS();
 	      GOTO_TOP;
 
-	    case 10:		/* LOAD-IMM-FIX signed-arg */
-	      /* Tag trickery and opcode knowledge changes this
-	         PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
-	         to this: */
-	      PUSHVAL_IMM((ref_t) (((int16_t) instr) >> 6));
+	    ARGED_CASE(10):		/* LOAD-IMM-FIX signed-arg */
+	      /* This used to be computed from instr with tag trickery,
+	         but instr is not set when running predecoded code. */
+	      PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
 	      GOTO_TOP;
 
-	    case 11:		/* STORE-STK n */
+	    ARGED_CASE(11):		/* STORE-STK n */
 	      {
 		ref_t *other;
 
@@ -1392,25 +1596,27 @@ loop(ref_t initial_tos)
 	      GOTO_TOP;
 
 
-	    case 12:		/* LOAD-BP n */
+	    ARGED_CASE(12):		/* LOAD-BP n */
 	      x = *(e_bp + arg_field);
 	      PUSHVAL(x);
 	      GOTO_TOP;
 
-	    case 13:		/* STORE-BP n */
+	    ARGED_CASE(13):		/* STORE-BP n */
 	      *(e_bp + arg_field) = PEEKVAL();
+	      WRITE_BARRIER(e_bp + arg_field);
 	      GOTO_TOP;
 
-	    case 14:		/* LOAD-ENV n */
+	    ARGED_CASE(14):		/* LOAD-ENV n */
 	      x = *(e_env + arg_field);
 	      PUSHVAL(x);
 	      GOTO_TOP;
 
-	    case 15:		/* STORE-ENV n */
+	    ARGED_CASE(15):		/* STORE-ENV n */
 	      *(e_env + arg_field) = PEEKVAL();
+	      WRITE_BARRIER(e_env + arg_field);
 	      GOTO_TOP;
 
-	    case 16:		/* LOAD-STK n */
+	    ARGED_CASE(16):		/* LOAD-STK n */
 	      /* All attempts to start this with if (arg_field == 0)
 	         for speed have failed, so benchmark carefully before
 	         trying it. */
@@ -1423,15 +1629,15 @@ loop(ref_t initial_tos)
 	      GOTO_TOP;
 
 
-	    case 17:		/* MAKE-BP-LOC n */
+	    ARGED_CASE(17):		/* MAKE-BP-LOC n */
 	      PUSHVAL(PTR_TO_LOC(e_bp + arg_field));
 	      GOTO_TOP;
 
-	    case 18:		/* MAKE-ENV-LOC n */
+	    ARGED_CASE(18):		/* MAKE-ENV-LOC n */
 	      PUSHVAL(PTR_TO_LOC(e_env + arg_field));
 	      GOTO_TOP;
 
-	    case 19:		/* STORE-REG reg */
+	    ARGED_CASE(19):		/* STORE-REG reg */
 	      x = PEEKVAL();
 	      switch (arg_field)
 		{
@@ -1487,6 +1693,17 @@ loop(ref_t initial_tos)
 		  GOTO_TOP;
 		case 14:
 		  CHECKTAG1(x, LOC_TAG, 1);
+#ifdef TLABS
+		  /* Within the thread's buffer, this just moves its point. */
+		  if (reg_set->tlab_end
+		      && reg_set->tlab_point <= LOC_TO_PTR(x)
+		      && LOC_TO_PTR(x) <= reg_set->tlab_end)
+		    {
+		      reg_set->tlab_point = LOC_TO_PTR(x);
+		      GOTO_TOP;
+		    }
+		  tlab_retire(reg_set);
+#endif
 		  free_point = LOC_TO_PTR(x);
 		  GOTO_TOP;
 		case 15:
@@ -1502,11 +1719,7 @@ loop(ref_t initial_tos)
 		  GOTO_TOP;
 		case 18:
 		  CHECKTAG1(x, INT_TAG, 1);
-		  e_next_newspace_size = REF_TO_INT(x);
-#ifdef MAX_NEW_SPACE_SIZE
-		  if (e_next_newspace_size > MAX_NEW_SPACE_SIZE)
-		    e_next_newspace_size = MAX_NEW_SPACE_SIZE;
-#endif
+		  e_next_newspace_size = heap_limit_newspace(REF_TO_INT(x), 0);
 		  GOTO_TOP;
 		case 19:
 		  e_method_type = x;
@@ -1527,7 +1740,7 @@ loop(ref_t initial_tos)
 		  GOTO_TOP;
 		}
 
-	    case 20:		/* LOAD-REG reg */
+	    ARGED_CASE(20):		/* LOAD-REG reg */
 	      switch (arg_field)
 		{
 		case 0:
@@ -1573,6 +1786,14 @@ loop(ref_t initial_tos)
 		  PUSHVAL(e_boot_code);
 		  GOTO_TOP;
 		case 14:
+#ifdef TLABS
+		  /* The thread allocates from its buffer while it has one. */
+		  if (reg_set->tlab_end)
+		    {
+		      PUSHVAL(PTR_TO_LOC(reg_set->tlab_point));
+		      GOTO_TOP;
+		    }
+#endif
 		  PUSHVAL(PTR_TO_LOC(free_point));
 		  GOTO_TOP;
 		case 15:
@@ -1606,7 +1827,7 @@ loop(ref_t initial_tos)
 		  GOTO_TOP;
 		}
 
-	    case 21:		/* FUNCALL-CXT, FUNCALL-CXT-BR distance */
+	    ARGED_CASE(21):		/* FUNCALL-CXT, FUNCALL-CXT-BR distance */
 	      /* NOTE: (FUNCALL-CXT) == (FUNCALL-CXT-BR 0) */
 
 	      POLL_SIGNALS();
@@ -1615,7 +1836,7 @@ loop(ref_t initial_tos)
 	      /* Fall through to tail recursive case: */
 	      goto funcall_tail;
 
-	    case 22:		/* FUNCALL-TAIL */
+	    ARGED_CASE(22):		/* FUNCALL-TAIL */
 
 	      /* This polling should not be moved below the trap
 	         label, since the interrupt code will fail on a fake
@@ -1639,7 +1860,26 @@ loop(ref_t initial_tos)
 	      if (e_current_method == e_false)
 		{		/* SEARCH */
 		  ref_t y_type = (e_nargs == 0) ? e_object_type : get_type(y);
+#ifdef CALL_SITE_CACHE
+		  call_site_cache_t *site;
+		  mcache_entry_t *hit;
+
+		  SYNC_METHOD_CACHES();
+		  site = CALL_SITE_CACHE_FOR(method_caches, local_epc);
+		  hit = call_site_lookup(method_caches, site, local_epc, x, y_type);
 
+		  /* Check this call site's cache first: */
+		  if (hit)
+		    {
+		      maybe_put(trace_mcache, "C");
+#ifndef FAST
+		      call_site_hits += 1;
+#endif
+		      e_current_method = hit->method;
+		      e_bp = REF_TO_PTR(y) + REF_TO_INT(hit->offset);
+		    }
+		  else
+#endif
 #ifdef OP_TYPE_METH_CACHE
 		  /* Check for cache hit: */
 		  if (y_type == REF_SLOT(x, OPERATION_CACHE_TYPE_OFF))
@@ -1649,31 +1889,65 @@ loop(ref_t initial_tos)
 		      e_bp =
 			REF_TO_PTR(y) +
 			REF_TO_INT(REF_SLOT(x, OPERATION_CACHE_TYPE_OFF_OFF));
+#ifdef CALL_SITE_CACHE
+#ifndef FAST
+		      call_site_misses += 1;
+#endif
+		      call_site_fill(site, y_type, e_current_method,
+				     REF_SLOT(x, OPERATION_CACHE_TYPE_OFF_OFF));
+#endif
 		    }
 		  else
 #endif
 		    {
-		      /* Search the type hierarchy. */
 		      ref_t meth_type, offset = INT_TO_REF(0);
+#ifdef METHOD_TABLE
+		      method_table_entry_t *m;
 
-		      find_method_type_pair(x, y_type,
-					    &e_current_method, &meth_type);
+#ifndef CALL_SITE_CACHE
+		      SYNC_METHOD_CACHES();
+#endif
+		      m = method_table_lookup(method_caches, x, y_type);
 
-		      if (e_current_method == e_nil)
+		      if (m)
 			{
-			  if (trace_traps) {
-			    printf("No handler for operation ");
-			    printref(stdout, x);
-			    printf(" type ");
-			    printref(stdout, y_type);
-			    printf("\n");
-			  }
-			  TRAP0(e_nargs + 1);
+			  maybe_put(trace_mcache, "T");
+#ifndef FAST
+			  method_table_hits += 1;
+#endif
+			  e_current_method = m->method;
+			  offset = m->offset;
+			}
+		      else
+#endif
+			{
+			  /* Search the type hierarchy. */
+			  find_method_type_pair(x, y_type,
+						&e_current_method, &meth_type);
+
+			  if (e_current_method == e_nil)
+			    {
+			      if (trace_traps) {
+				printf("No handler for operation ");
+				printref(stdout, x);
+				printf(" type ");
+				printref(stdout, y_type);
+				printf("\n");
+			      }
+			      TRAP0(e_nargs + 1);
+			    }
+
+			  /* This could be dispensed with if meth_type has no
+			     ivars and isn't variable-length-mixin. */
+			  offset = lookup_bp_offset(y_type, meth_type);
+#ifdef METHOD_TABLE
+#ifndef FAST
+			  method_table_misses += 1;
+#endif
+			  method_table_enter(method_caches, x, y_type,
+					     e_current_method, offset, meth_type);
+#endif
 			}
-
-		      /* This could be dispensed with if meth_type has no
-		         ivars and isn't variable-length-mixin. */
-		      offset = lookup_bp_offset(y_type, meth_type);
 		      e_bp = REF_TO_PTR(y) + REF_TO_INT(offset);
 
 #ifdef OP_TYPE_METH_CACHE
@@ -1682,6 +1956,14 @@ loop(ref_t initial_tos)
 		      REF_SLOT(x, OPERATION_CACHE_TYPE_OFF) = y_type;
 		      REF_SLOT(x, OPERATION_CACHE_METH_OFF) = e_current_method;
 		      REF_SLOT(x, OPERATION_CACHE_TYPE_OFF_OFF) = offset;
+		      WRITE_BARRIER(&REF_SLOT(x, OPERATION_CACHE_TYPE_OFF));
+		      WRITE_BARRIER(&REF_SLOT(x, OPERATION_CACHE_METH_OFF));
+#endif
+#ifdef CALL_SITE_CACHE
+#ifndef FAST
+		      call_site_misses += 1;
+#endif
+		      call_site_fill(site, y_type, e_current_method, offset);
 #endif
 		    }
 		}
@@ -1700,13 +1982,14 @@ loop(ref_t initial_tos)
 	      e_env = REF_TO_PTR(REF_SLOT(x, METHOD_ENV_OFF));
 	      local_epc = CODE_SEG_FIRST_INSTR(e_code_segment =
 					       REF_SLOT(x, METHOD_CODE_OFF));
+	      ENTER_CODE_SEGMENT();
 	      GOTO_TOP;
 
-	    case 23:		/* STORE-NARGS n */
+	    ARGED_CASE(23):		/* STORE-NARGS n */
 	      e_nargs = arg_field;
 	      GOTO_TOP;
 
-	    case 24:		/* CHECK-NARGS n */
+	    ARGED_CASE(24):		/* CHECK-NARGS n */
 	      if (e_nargs == arg_field)
 		{
 		  POPVALS(1);
@@ -1720,7 +2003,7 @@ loop(ref_t initial_tos)
 		}
 	      GOTO_TOP;
 
-	    case 25:		/* CHECK-NARGS-GTE n */
+	    ARGED_CASE(25):		/* CHECK-NARGS-GTE n */
 	      if (e_nargs >= arg_field)
 		{
 		  POPVALS(1);
@@ -1734,18 +2017,33 @@ loop(ref_t initial_tos)
 		}
 	      GOTO_TOP;
 
-	    case 26:		/* STORE-SLOT n */
+	    ARGED_CASE(26):		/* STORE-SLOT n */
 	      POPVAL(x);
 	      CHECKTAG1(x, PTR_TAG, 2);
 	      REF_SLOT(x, arg_field) = PEEKVAL();
+	      WRITE_BARRIER(&REF_SLOT(x, arg_field));
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+	      /* The world flushes the method cache of an operation this
+	         way before and again after it adds a method, which may
+	         make the other caches wrong too.  The second flush keeps
+	         another thread from caching the old method for good
+	         between the first and the install.  Other objects may
+	         store 0 in this slot too, so x is checked to be an
+	         operation, or an instance of a subtype of operation. */
+	      if (arg_field == OPERATION_CACHE_TYPE_OFF
+		  && PEEKVAL() == INT_TO_REF(0)
+		  && lookup_bp_offset(REF_SLOT(x, 0), e_operation_type)
+		  != INT_TO_REF(0))
+		invalidate_method_caches(method_caches, x);
+#endif
 	      GOTO_TOP;
 
-	    case 27:		/* LOAD-SLOT n */
+	    ARGED_CASE(27):		/* LOAD-SLOT n */
 	      CHECKTAG0(PEEKVAL(), PTR_TAG, 1);
 	      PEEKVAL() = REF_SLOT(PEEKVAL(), arg_field);
 	      GOTO_TOP;
 
-	    case 28:		/* MAKE-CLOSED-ENVIRONMENT n */
+	    ARGED_CASE(28):		/* MAKE-CLOSED-ENVIRONMENT n */
 	      /* This code might be in error if arg_field == 0, which the
 	         compiler should never generate. */
 	      {
@@ -1776,18 +2074,18 @@ loop(ref_t initial_tos)
 	      }
 	      GOTO_TOP;
 
-	    case 29:		/* PUSH-CXT rel */
+	    ARGED_CASE(29):		/* PUSH-CXT rel */
 
 	      PUSH_CONTEXT(signed_arg_field);
 	      GOTO_TOP;
 
 
-	    case 30:		/* LOCATE-SLOT n */
+	    ARGED_CASE(30):		/* LOCATE-SLOT n */
 	      PEEKVAL()
 		= PTR_TO_LOC(REF_TO_PTR(PEEKVAL()) + arg_field);
 	      GOTO_TOP;
 
-	    case 31:		/* STREAM-PRIMITIVE n */
+	    ARGED_CASE(31):		/* STREAM-PRIMITIVE n */
 	      switch (arg_field)
 		{
 		case 0:	/* get standard input stream. */
@@ -1903,7 +2201,7 @@ loop(ref_t initial_tos)
 		  GOTO_TOP;
 		}
 
-	    case 32:		/* FILLTAG n */
+	    ARGED_CASE(32):		/* FILLTAG n */
 	      /* This implements CATCH/THROW */
 	      x = PEEKVAL();
 	      CHECKTAG0(x, PTR_TAG, 1);
@@ -1913,7 +2211,7 @@ loop(ref_t initial_tos)
 		= INT_TO_REF(CONTEXT_STACK_HEIGHT());
 	      GOTO_TOP;
 
-	    case 33:		/* ^SUPER-CXT, ^SUPER-CXT-BR distance */
+	    ARGED_CASE(33):		/* ^SUPER-CXT, ^SUPER-CXT-BR distance */
 	      /* Analogous to FUNCALL-CXT[-BR]. */
 
 	      POLL_SIGNALS();
@@ -1924,7 +2222,7 @@ loop(ref_t initial_tos)
 	      goto super_tail;
 
 
-	    case 34:		/* ^SUPER-TAIL */
+	    ARGED_CASE(34):		/* ^SUPER-TAIL */
 
 	      /* Do not move this below the label! */
 
@@ -1933,7 +2231,7 @@ loop(ref_t initial_tos)
 	      /******************/
 	    super_tail:
 	      /******************/
-	      /* No cache, no LAMBDA hack, things are easy.
+	      /* No LAMBDA hack, things are easy.
 	         Maybe not looking at the lambda hack is a bug?
 
 	         On stack: type, operation, self, args... */
@@ -1941,6 +2239,10 @@ loop(ref_t initial_tos)
 		ref_t the_type;
 		ref_t y_type;
 		ref_t meth_type;
+		ref_t offset;
+#ifdef METHOD_TABLE
+		method_table_entry_t *m;
+#endif
 
 		POPVAL(the_type);
 		CHECKTAG1(the_type, PTR_TAG, e_nargs + 2);
@@ -1954,24 +2256,58 @@ loop(ref_t initial_tos)
 
 		y_type = get_type(y);
 
-		e_current_method = e_nil;
+#ifdef METHOD_TABLE
+		SYNC_METHOD_CACHES();
+		if ((m = method_table_lookup(method_caches, x, the_type)) != NULL)
+		  {
+		    maybe_put(trace_mcache, "S");
+#ifndef FAST
+		    method_table_hits += 1;
+#endif
+		    e_current_method = m->method;
+		    meth_type = m->method_type;
+		  }
+		else
+#endif
+		  {
+		    e_current_method = e_nil;
 
-		find_method_type_pair(x, the_type,
-				      &e_current_method, &meth_type);
+		    find_method_type_pair(x, the_type,
+					  &e_current_method, &meth_type);
 
-		if (e_current_method == e_nil)
-		  {
-		    if (trace_traps)
-		      printf("No handler for ^super operation.\n");
-		    PUSHVAL(the_type);
-		    TRAP0(e_nargs + 2);
+		    if (e_current_method == e_nil)
+		      {
+			if (trace_traps)
+			  printf("No handler for ^super operation.\n");
+			PUSHVAL(the_type);
+			TRAP0(e_nargs + 2);
+		      }
+#ifdef METHOD_TABLE
+#ifndef FAST
+		    method_table_misses += 1;
+#endif
+		    m = method_table_enter(method_caches, x, the_type,
+					   e_current_method,
+					   lookup_bp_offset(the_type, meth_type),
+					   meth_type);
+#endif
 		  }
+
 		/* This could be dispensed with if meth_type has no
 		   ivars and isn't variable-length-mixin. */
-		{
-		  ref_t offset = lookup_bp_offset(y_type, meth_type);
-		  e_bp = REF_TO_PTR(y) + REF_TO_INT(offset);
-		}
+#ifdef METHOD_TABLE
+		if (m->super_receiver == y_type)
+		  offset = m->super_offset;
+		else
+		  {
+		    offset = lookup_bp_offset(y_type, meth_type);
+		    m->super_receiver = y_type;
+		    m->super_offset = offset;
+		  }
+#else
+		offset = lookup_bp_offset(y_type, meth_type);
+#endif
+		e_bp = REF_TO_PTR(y) + REF_TO_INT(offset);
 	      }
 
 	      x = e_current_method;
@@ -1979,10 +2315,14 @@ loop(ref_t initial_tos)
 	      e_env = REF_TO_PTR(REF_SLOT(x, METHOD_ENV_OFF));
 	      local_epc = CODE_SEG_FIRST_INSTR(e_code_segment =
 					       REF_SLOT(x, METHOD_CODE_OFF));
+	      ENTER_CODE_SEGMENT();
 	      GOTO_TOP;
 
-#ifndef FAST
+#include "superinstr-loop.h"
+
+#if !defined(FAST) || defined(THREADED_DISPATCH)
 	    default:
+	    DISPATCH_LABEL(arged_illegal)
 	      printf("\nError (vm interpreter): "
 		     "Illegal parametric instruction %d\n", op_field);
 	      UNLOCALIZE_ALL();
@@ -0,0 +1,302 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "gc.h"
+#include "threads.h"
+#include "mcache.h"
+
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+
+#ifdef THREADS
+method_caches_t *method_caches_array[MAX_THREAD_COUNT];
+volatile unsigned long method_cache_generation = 0;
+#else
+method_caches_t the_method_caches;
+#endif
+
+#ifndef FAST
+unsigned long call_site_hits = 0;
+unsigned long call_site_misses = 0;
+unsigned long call_site_megamorphic = 0;
+unsigned long method_table_hits = 0;
+unsigned long method_table_misses = 0;
+#endif
+
+#endif
+
+
+#ifdef CALL_SITE_CACHE
+
+/*
+ * Polymorphic inline caches for FUNCALL and FUNCALL-TAIL.
+ *
+ * Rather than patching the code vectors, the caches live in a direct
+ * mapped side table indexed by the address of the call site.  They
+ * hold raw references, so rather than being scanned by the gc they
+ * are all discarded after each gc by bumping the epoch, which makes
+ * every cache stale at once.
+ */
+
+void
+flush_call_site_caches(method_caches_t * mc)
+{
+  mc->epoch += 1;
+}
+
+#endif
+
+
+#ifdef METHOD_TABLE
+
+/*
+ * The global method table.
+ *
+ * It caches the results of find_method_type_pair() and
+ * lookup_bp_offset() for every (operation, type) pair that misses the
+ * faster caches, and for the types ^SUPER sends start searching at.
+ * The type hierarchy above an existing type never changes, since a
+ * type is initialized only when it is made, so the only thing that
+ * makes an entry wrong is adding a method to its operation; then all
+ * entries for the operation are removed.  Like the predecoded code
+ * table, the table is rebuilt after each gc, moving entries whose
+ * objects were transported and dropping those whose operation or type
+ * died.
+ */
+
+#define METHOD_TABLE_INITIAL_SIZE 1024
+
+
+static method_table_entry_t *
+method_table_slot(method_table_entry_t * table, unsigned long mask,
+		  ref_t op, ref_t type)
+{
+  unsigned long i = METHOD_TABLE_HASH(op, type) & mask;
+
+  while (table[i].operation != 0
+	 && (table[i].operation != op || table[i].type != type))
+    i = (i + 1) & mask;
+  return &table[i];
+}
+
+/* Rebuild the table at the given size, keeping only the entries for
+   which keep() returns true.  keep() may update the entry. */
+static unsigned long
+rehash_method_table(method_caches_t * mc, unsigned long size,
+		    int (*keep) (method_table_entry_t *, ref_t), ref_t arg)
+{
+  method_table_entry_t *old = mc->method_table;
+  unsigned long i, old_size = old ? mc->method_table_mask + 1 : 0;
+  unsigned long discard_count = 0;
+
+  mc->method_table =
+    (method_table_entry_t *) xmalloc(size * sizeof(method_table_entry_t));
+  mc->method_table_mask = size - 1;
+  mc->method_table_count = 0;
+  for (i = 0; i < size; i++)
+    mc->method_table[i].operation = 0;
+
+  for (i = 0; i < old_size; i++)
+    {
+      method_table_entry_t e = old[i];
+
+      if (e.operation == 0)
+	continue;
+      if (keep && !keep(&e, arg))
+	{
+	  discard_count += 1;
+	  continue;
+	}
+      *method_table_slot(mc->method_table, mc->method_table_mask,
+			 e.operation, e.type) = e;
+      mc->method_table_count += 1;
+    }
+
+  free(old);
+  return discard_count;
+}
+
+method_table_entry_t *
+method_table_enter(method_caches_t * mc, ref_t op, ref_t type,
+		   ref_t method, ref_t offset, ref_t method_type)
+{
+  method_table_entry_t *e;
+
+  /* Keep the load factor under one half. */
+  if (2 * (mc->method_table_count + 1) > mc->method_table_mask + 1)
+    rehash_method_table(mc, 2 * (mc->method_table_mask + 1), NULL, 0);
+
+  e = method_table_slot(mc->method_table, mc->method_table_mask, op, type);
+  if (e->operation == 0)
+    mc->method_table_count += 1;
+  e->operation = op;
+  e->type = type;
+  e->method = method;
+  e->offset = offset;
+  e->method_type = method_type;
+  e->super_receiver = 0;
+  return e;
+}
+
+
+static int
+keep_live_entry(method_table_entry_t * e, ref_t unused)
+{
+  if (!(gc_forward(&e->operation) && gc_forward(&e->type)
+	&& gc_forward(&e->method) && gc_forward(&e->method_type)))
+    return 0;
+  if (e->super_receiver != 0 && !gc_forward(&e->super_receiver))
+    e->super_receiver = 0;
+  return 1;
+}
+
+unsigned long
+post_gc_method_table(method_caches_t * mc)
+{
+  return rehash_method_table(mc, mc->method_table_mask + 1,
+			     keep_live_entry, 0);
+}
+
+static int
+keep_other_operation(method_table_entry_t * e, ref_t op)
+{
+  return e->operation != op;
+}
+
+static int
+keep_none(method_table_entry_t * e, ref_t unused)
+{
+  return 0;
+}
+
+#endif
+
+
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+
+#ifndef FAST
+static void
+print_method_cache_counts(void)
+{
+  if (!trace_mcache)
+    return;
+#ifdef CALL_SITE_CACHE
+  fprintf(stderr,
+	  "; Call site caches: %lu hit%s, %lu miss%s, %lu megamorphic.\n",
+	  call_site_hits, call_site_hits != 1 ? "s" : "",
+	  call_site_misses, call_site_misses != 1 ? "es" : "",
+	  call_site_megamorphic);
+#endif
+#ifdef METHOD_TABLE
+  fprintf(stderr, "; Method table: %lu hit%s, %lu miss%s.\n",
+	  method_table_hits, method_table_hits != 1 ? "s" : "",
+	  method_table_misses, method_table_misses != 1 ? "es" : "");
+#endif
+}
+#endif
+
+/* Set up the method caches of the calling thread. */
+void
+init_method_caches(void)
+{
+#ifdef THREADS
+  int my_index = *(int *)pthread_getspecific(index_key);
+
+  method_caches = (method_caches_t *) xmalloc(sizeof(method_caches_t));
+  memset(method_caches, 0, sizeof(method_caches_t));
+  method_caches->generation = method_cache_generation;
+#endif
+
+#ifdef CALL_SITE_CACHE
+  /* Call site caches are zeroed, so this makes them all stale. */
+  flush_call_site_caches(method_caches);
+#endif
+#ifdef METHOD_TABLE
+  method_caches->method_table = NULL;
+  rehash_method_table(method_caches, METHOD_TABLE_INITIAL_SIZE, NULL, 0);
+#endif
+#ifndef FAST
+#ifdef THREADS
+  if (my_index == 0)
+#endif
+    atexit(print_method_cache_counts);
+#endif
+}
+
+/* Called before and after a method is added to op by the thread
+   owning mc.  Its own caches lose just the entries for op.  With
+   THREADS, the other threads see method_cache_generation change and
+   empty theirs in sync_method_caches(). */
+void
+invalidate_method_caches(method_caches_t * mc, ref_t op)
+{
+#ifdef CALL_SITE_CACHE
+  unsigned long i;
+
+  for (i = 0; i < CALL_SITE_CACHE_SIZE; i++)
+    if (mc->call_site_cache[i].operation == op)
+      mc->call_site_cache[i].epoch = 0;
+#endif
+#ifdef METHOD_TABLE
+  {
+    unsigned long j;
+
+    for (j = 0; j <= mc->method_table_mask; j++)
+      if (mc->method_table[j].operation == op)
+	{
+	  rehash_method_table(mc, mc->method_table_mask + 1,
+			      keep_other_operation, op);
+	  break;
+	}
+  }
+#endif
+#ifdef THREADS
+  {
+    unsigned long g = __sync_fetch_and_add(&method_cache_generation, 1);
+
+    /* Unless another thread added a method meanwhile, this thread is
+       already up to date. */
+    if (mc->generation == g)
+      mc->generation = g + 1;
+  }
+#endif
+}
+
+void
+sync_method_caches(method_caches_t * mc)
+{
+#ifdef THREADS
+  mc->generation = method_cache_generation;
+  __sync_synchronize();
+#endif
+#ifdef CALL_SITE_CACHE
+  flush_call_site_caches(mc);
+#endif
+#ifdef METHOD_TABLE
+  rehash_method_table(mc, mc->method_table_mask + 1, keep_none, 0);
+#endif
+}
+
+#endif
@@ -0,0 +1,219 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+
+#ifndef _MCACHE_H_INCLUDED
+#define _MCACHE_H_INCLUDED
+
+#include "config.h"
+#include "data.h"
+
+#ifdef CALL_SITE_CACHE
+
+/* Number of receiver types remembered at each call site.  A site
+   that sees more than this many types is megamorphic, and skips its
+   cache until the next flush. */
+#ifndef CALL_SITE_CACHE_ENTRIES
+#define CALL_SITE_CACHE_ENTRIES 4
+#endif
+
+/* Number of call sites in the cache; must be a power of two. */
+#ifndef CALL_SITE_CACHE_SIZE
+#define CALL_SITE_CACHE_SIZE 2048
+#endif
+
+typedef struct
+{
+  ref_t type;			/* receiver type */
+  ref_t method;			/* method found for it */
+  ref_t offset;			/* bp offset, as from lookup_bp_offset() */
+} mcache_entry_t;
+
+/* The polymorphic inline cache of one FUNCALL instruction, which is
+   identified by the pc just past it.  Everything in it is valid only
+   while epoch matches that of the method caches holding it. */
+typedef struct
+{
+  u_int16_t *site;
+  ref_t operation;
+  unsigned long epoch;
+  int count;			/* entries in use, -1 if megamorphic */
+  mcache_entry_t entries[CALL_SITE_CACHE_ENTRIES];
+} call_site_cache_t;
+
+#endif
+
+#ifdef METHOD_TABLE
+
+/* An open addressed hash table from (operation, receiver type) to the
+   method and bp offset that searching the type hierarchy finds.  It
+   also serves ^SUPER sends, keyed by the type the search starts at;
+   they need the type holding the method to find their bp offset, and
+   remember the offset for the last receiver type. */
+typedef struct
+{
+  ref_t operation;		/* 0 if the slot is empty */
+  ref_t type;
+  ref_t method;
+  ref_t offset;
+  ref_t method_type;		/* the type the method was found in */
+  ref_t super_receiver;		/* 0, or the type super_offset is for */
+  ref_t super_offset;
+} method_table_entry_t;
+
+#define METHOD_TABLE_HASH(op, type) \
+  ((unsigned long)(((u_int32_t)(op) ^ ((u_int32_t)(type) >> 3)) \
+		   * 2654435769u) >> 4)
+
+#endif
+
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+
+/* All the method caches of one thread.  With THREADS every thread
+   has its own, so lookups and fills need no locking; see
+   sync_method_caches() for how adding a method reaches the others. */
+typedef struct
+{
+#ifdef CALL_SITE_CACHE
+  call_site_cache_t call_site_cache[CALL_SITE_CACHE_SIZE];
+  unsigned long epoch;
+#endif
+#ifdef METHOD_TABLE
+  method_table_entry_t *method_table;
+  unsigned long method_table_mask;
+  unsigned long method_table_count;	/* slots in use */
+#endif
+#ifdef THREADS
+  unsigned long generation;	/* of method_cache_generation seen */
+#endif
+} method_caches_t;
+
+#ifdef THREADS
+extern method_caches_t *method_caches_array[MAX_THREAD_COUNT];
+extern volatile unsigned long method_cache_generation;
+#define method_caches (method_caches_array[my_index])
+#else
+extern method_caches_t the_method_caches;
+#define method_caches (&the_method_caches)
+#endif
+
+/* The counters are only for --trace-mcache, so with THREADS they are
+   shared and updated without locking. */
+#ifndef FAST
+extern unsigned long call_site_hits, call_site_misses,
+  call_site_megamorphic, method_table_hits, method_table_misses;
+#endif
+
+extern void init_method_caches(void);
+extern void invalidate_method_caches(method_caches_t * mc, ref_t op);
+extern void sync_method_caches(method_caches_t * mc);
+
+/* Called before a lookup.  With THREADS, catch up with methods added
+   by other threads. */
+#ifdef THREADS
+#define SYNC_METHOD_CACHES()					\
+{	if (method_caches->generation != method_cache_generation)	\
+	  sync_method_caches(method_caches);			\
+}
+#else
+#define SYNC_METHOD_CACHES()
+#endif
+
+#endif
+
+#ifdef CALL_SITE_CACHE
+
+extern void flush_call_site_caches(method_caches_t * mc);
+
+#define CALL_SITE_CACHE_FOR(mc, pc) \
+  (&(mc)->call_site_cache[((unsigned long)(pc) >> 1) \
+			  & (CALL_SITE_CACHE_SIZE - 1)])
+
+/* Returns the entry for receiver type at the call site, or NULL.  A
+   slot holding another site, another operation, or stale contents is
+   taken over for this one. */
+static inline mcache_entry_t *
+call_site_lookup(method_caches_t * mc, call_site_cache_t * c,
+		 u_int16_t * pc, ref_t op, ref_t type)
+{
+  int i;
+
+  if (c->site != pc || c->operation != op || c->epoch != mc->epoch)
+    {
+      c->site = pc;
+      c->operation = op;
+      c->epoch = mc->epoch;
+      c->count = 0;
+      return NULL;
+    }
+
+  for (i = 0; i < c->count; i++)
+    if (c->entries[i].type == type)
+      return &c->entries[i];
+
+  return NULL;
+}
+
+static inline void
+call_site_fill(call_site_cache_t * c, ref_t type, ref_t method,
+	       ref_t offset)
+{
+  if (c->count < 0)
+    return;
+  if (c->count == CALL_SITE_CACHE_ENTRIES)
+    {
+      c->count = -1;
+#ifndef FAST
+      call_site_megamorphic += 1;
+#endif
+      return;
+    }
+  c->entries[c->count].type = type;
+  c->entries[c->count].method = method;
+  c->entries[c->count].offset = offset;
+  c->count += 1;
+}
+
+#endif
+
+#ifdef METHOD_TABLE
+
+extern method_table_entry_t *method_table_enter(method_caches_t * mc,
+						ref_t op, ref_t type,
+						ref_t method, ref_t offset,
+						ref_t method_type);
+extern unsigned long post_gc_method_table(method_caches_t * mc);
+
+static inline method_table_entry_t *
+method_table_lookup(method_caches_t * mc, ref_t op, ref_t type)
+{
+  method_table_entry_t *table = mc->method_table;
+  unsigned long mask = mc->method_table_mask;
+  unsigned long i = METHOD_TABLE_HASH(op, type) & mask;
+
+  while (table[i].operation != 0)
+    {
+      if (table[i].operation == op && table[i].type == type)
+	return &table[i];
+      i = (i + 1) & mask;
+    }
+  return NULL;
+}
+
+#endif
+
+#endif
@@ -32,10 +32,16 @@
 #include "data.h"
 #include "cmdline.h"
 #include "weak.h"
+#include "idhash.h"
+#include "predecode.h"
+#include "mcache.h"
+#include "profile.h"
+#include "allocprof.h"
 #include "stacks.h"
 #include "worldio.h"
 #include "loop.h"
 #include "xmalloc.h"
+#include "heap.h"
 
 
 int
@@ -53,8 +59,6 @@ main(int argc, char **argv)
   pthread_setspecific (index_key, (void*)my_index_p);
   my_index_p = pthread_getspecific(index_key);
   my_index = *my_index_p;
-  gc_ready[my_index] = 0;
-  /* inc_next_index();*/
   value_stack_array[my_index] = (oakstack*)malloc (sizeof (oakstack));
   cntxt_stack_array[my_index] = (oakstack*)malloc(sizeof (oakstack));
   value_stack.size = 1024;
@@ -67,12 +71,33 @@ main(int argc, char **argv)
   parse_cmd_line(argc, argv);
 
   init_weakpointer_tables();
+  init_identity_hash_tables();
+
+#ifdef PREDECODE
+  init_predecode_table();
+#endif
+
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+  init_method_caches();
+#endif
+
+#ifdef PROFILE_INSTRUCTIONS
+  if (profile_file_name)
+    init_instruction_profile();
+#endif
+
+#ifdef ALLOCATION_PROFILE
+  if (alloc_profile_file_name)
+    init_allocation_profile();
+#endif
 
   init_stacks();
 
   read_world(world_file_name);
 
-  new_space.size = e_next_newspace_size = original_newspace_size;
+  init_heap_policy();
+  new_space.size = e_next_newspace_size =
+    heap_limit_newspace(original_newspace_size, 0);
   alloc_space(&new_space, new_space.size);
   free_point = new_space.start;
 
@@ -81,6 +106,12 @@ main(int argc, char **argv)
 #else
   reg_set = (register_set_t*)malloc(sizeof(register_set_t));
 #endif
+#ifdef TLABS
+  reg_set->tlab_point = reg_set->tlab_end = NULL;
+#endif
+#ifdef ALLOCATION_PROFILE
+  reg_set->alloc_countdown = ALLOCATION_COUNTDOWN();
+#endif
 
   /* Set the registers to the boot code */
 
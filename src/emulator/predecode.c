@@ -0,0 +1,228 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "gc.h"
+#include "predecode.h"
+
+#ifdef PREDECODE
+
+/*
+ * Side tables of predecoded instructions, one per hot code vector.
+ *
+ * They live in malloc()ed memory and are found through an open
+ * addressed hash table keyed by the address of the code vector.  The
+ * table also counts how often cold code vectors are entered, so only
+ * those that are used repeatedly get decoded.  As with the weak
+ * pointer hash table, the keys are addresses, so after each gc the
+ * table is rebuilt: entries for code vectors that were transported
+ * are moved to their new addresses, and those for code vectors that
+ * died are freed.
+ */
+
+#define PREDECODE_INITIAL_SIZE 1024
+
+/* The superinstructions, by the opcode of their first instruction and
+   the 16-bit word (under a mask) their first shadow must be.  Code
+   vectors compiled without them get them when predecoded: the
+   superinstruction handler behaves like the instruction it replaces
+   and takes over its shadows only when they really follow, so a head
+   whose first shadow matches can safely be replaced by it. */
+static const int superinstr_head[64] = {
+  [0 ... 63] = -1,
+#define SUPERINSTR_HEADS
+#include "superinstr-loop.h"
+#undef SUPERINSTR_HEADS
+};
+
+static const struct
+{
+  u_int16_t mask, value;
+} superinstr_shadow[64] = {
+#define SUPERINSTR_SHADOWS
+#include "superinstr-loop.h"
+#undef SUPERINSTR_SHADOWS
+};
+
+predecode_entry_t *predecode_table;
+unsigned long predecode_mask;
+static unsigned long predecode_count = 0;	/* slots in use */
+
+
+static predecode_entry_t *
+predecode_slot(predecode_entry_t * table, unsigned long mask, ref_t seg)
+{
+  unsigned long i = PREDECODE_HASH(seg) & mask;
+
+  while (table[i].segment != 0 && table[i].segment != seg)
+    i = (i + 1) & mask;
+  return &table[i];
+}
+
+static void
+rehash_predecode_table(unsigned long size)
+{
+  predecode_entry_t *old = predecode_table;
+  unsigned long i, old_size = old ? predecode_mask + 1 : 0;
+
+  predecode_table =
+    (predecode_entry_t *) xmalloc(size * sizeof(predecode_entry_t));
+  predecode_mask = size - 1;
+  for (i = 0; i < size; i++)
+    {
+      predecode_table[i].segment = 0;
+      predecode_table[i].entries = 0;
+      predecode_table[i].code = NULL;
+    }
+
+  for (i = 0; i < old_size; i++)
+    if (old[i].segment != 0)
+      *predecode_slot(predecode_table, predecode_mask, old[i].segment) =
+	old[i];
+
+  free(old);
+}
+
+void
+init_predecode_table(void)
+{
+  predecode_table = NULL;
+  predecode_count = 0;
+  rehash_predecode_table(PREDECODE_INITIAL_SIZE);
+}
+
+
+static predecoded_code_t *
+predecode(ref_t seg, const predecode_handlers_t * h)
+{
+  u_int16_t *base = CODE_SEG_FIRST_INSTR(seg);
+  unsigned long i, n =
+    2 * (REF_TO_INT(REF_SLOT(seg, 1)) - CODE_CODE_START_OFF);
+  predecoded_code_t *code =
+    (predecoded_code_t *) xmalloc(sizeof(predecoded_code_t)
+				  + n * sizeof(predecoded_instr_t));
+
+  code->segment = seg;
+  code->base = base;
+  code->length = n;
+
+  for (i = 0; i < n; i++)
+    {
+      u_int16_t instr = base[i];
+      predecoded_instr_t *d = &code->instrs[i];
+
+      d->op_field = (instr >> 2) & 0x3F;
+      d->arg_field = instr >> 8;
+
+      if (d->op_field != 0)
+	{
+	  unsigned k;
+
+	  if (i + 1 < n)
+	    for (k = 0; k < 64; k++)
+	      if (superinstr_head[k] == d->op_field
+		  && (base[i + 1] & superinstr_shadow[k].mask)
+		  == superinstr_shadow[k].value)
+		{
+		  d->op_field = k;
+		  break;
+		}
+	  d->handler = h->arged[d->op_field];
+	}
+      else if (((unsigned long)&base[i + 1] & 2) != 0)
+	d->handler = h->argless[d->arg_field];
+      else if (d->arg_field == 6)	/* LOAD-IMM */
+	d->handler = h->load_imm_aligned;
+      else if (d->arg_field == 39)	/* LOAD-IMM-CON */
+	d->handler = h->load_imm_con_aligned;
+      else
+	d->handler = h->argless[d->arg_field];
+    }
+
+  return code;
+}
+
+predecoded_code_t *
+predecode_enter(ref_t seg, const predecode_handlers_t * h)
+{
+  predecode_entry_t *e =
+    predecode_slot(predecode_table, predecode_mask, seg);
+
+  if (e->segment == 0)
+    {
+      /* Keep the load factor under one half. */
+      if (2 * (predecode_count + 1) > predecode_mask + 1)
+	{
+	  rehash_predecode_table(2 * (predecode_mask + 1));
+	  e = predecode_slot(predecode_table, predecode_mask, seg);
+	}
+      e->segment = seg;
+      predecode_count += 1;
+    }
+
+  if (e->code == NULL && ++e->entries >= PREDECODE_THRESHOLD)
+    e->code = predecode(seg, h);
+
+  return e->code;
+}
+
+
+unsigned long
+post_gc_predecode(void)
+{
+  predecode_entry_t *old = predecode_table;
+  unsigned long i, old_size = predecode_mask + 1;
+  unsigned long discard_count = 0;
+
+  predecode_table = NULL;
+  predecode_count = 0;
+  rehash_predecode_table(old_size);
+
+  for (i = 0; i < old_size; i++)
+    {
+      predecode_entry_t e = old[i];
+
+      if (e.segment == 0)
+	continue;
+
+      if (!gc_forward(&e.segment))
+	{
+	  free(e.code);
+	  discard_count += 1;
+	  continue;
+	}
+      if (e.code)
+	{
+	  e.code->segment = e.segment;
+	  e.code->base = CODE_SEG_FIRST_INSTR(e.segment);
+	}
+
+      *predecode_slot(predecode_table, predecode_mask, e.segment) = e;
+      predecode_count += 1;
+    }
+
+  free(old);
+  return discard_count;
+}
+
+#endif
@@ -0,0 +1,98 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#ifndef _PREDECODE_H_INCLUDED
+#define _PREDECODE_H_INCLUDED
+
+#include "config.h"
+#include "data.h"
+
+#ifdef PREDECODE
+
+/* Number of times control must enter a code vector before it is
+   predecoded. */
+#ifndef PREDECODE_THRESHOLD
+#define PREDECODE_THRESHOLD 8
+#endif
+
+/* One instruction, already split into its fields and resolved to the
+   address of its handler in loop(). */
+typedef struct
+{
+  void *handler;
+  u_int8_t op_field;
+  u_int8_t arg_field;
+} predecoded_instr_t;
+
+/* The side table for one code vector.  There is an entry for every
+   16-bit word after CODE_CODE_START_OFF, including those that hold
+   inline data and are never executed, so the entry for an instruction
+   is found by subtracting base from the pc. */
+typedef struct
+{
+  ref_t segment;		/* the code vector; updated by the gc */
+  u_int16_t *base;		/* its first instruction */
+  unsigned long length;		/* number of entries */
+  predecoded_instr_t instrs[];
+} predecoded_code_t;
+
+/* Handler addresses, supplied by loop() since they are labels inside
+   it.  The aligned handlers are LOAD-IMM and LOAD-IMM-CON entered
+   past their pc alignment test, for instructions whose immediate
+   needs no padding. */
+typedef struct
+{
+  void *const *argless;		/* indexed by argument field */
+  void *const *arged;		/* indexed by opcode field */
+  void *load_imm_aligned;
+  void *load_imm_con_aligned;
+} predecode_handlers_t;
+
+typedef struct
+{
+  ref_t segment;		/* 0 if the slot is empty */
+  unsigned long entries;	/* times control has entered segment */
+  predecoded_code_t *code;	/* NULL until segment gets hot */
+} predecode_entry_t;
+
+extern predecode_entry_t *predecode_table;
+extern unsigned long predecode_mask;
+
+#define PREDECODE_HASH(seg) \
+  ((unsigned long)((u_int32_t)(seg) * 2654435769u) >> 4)
+
+extern void init_predecode_table(void);
+extern predecoded_code_t *predecode_enter(ref_t seg,
+					  const predecode_handlers_t * h);
+extern unsigned long post_gc_predecode(void);
+
+/* Called whenever control enters a code vector.  Returns its side
+   table, or NULL if it is not hot yet. */
+static inline predecoded_code_t *
+predecoded_code(ref_t seg, const predecode_handlers_t * h)
+{
+  predecode_entry_t *e =
+    &predecode_table[PREDECODE_HASH(seg) & predecode_mask];
+
+  if (e->segment == seg && e->code)
+    return e->code;
+  return predecode_enter(seg, h);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#define _REENTRANT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "data.h"
+#include "xmalloc.h"
+#include "profile.h"
+
+#ifdef PROFILE_INSTRUCTIONS
+
+/*
+ * Instruction profiling, for --profile-instructions.
+ *
+ * Every instruction executed is counted by its opcode and argument
+ * fields, and every pair of consecutive instructions by their
+ * classes: the argument field for argless instructions, and the
+ * opcode for arged ones, whose arguments are operands.  The counts
+ * are written out at exit as forms that instruction-table.oak reads.
+ *
+ * In the THREADS emulator the counts are not locked, so they are
+ * only approximate.
+ */
+
+#define PROFILE_CLASSES		(256 + 64)
+#define PROFILE_CLASS(op, arg)	((op) == 0 ? (arg) : 256 + (op))
+
+char *profile_file_name = NULL;	/* set by --profile-instructions */
+
+static unsigned long *instr_counts;	/* [op_field][arg_field] */
+static unsigned long *bigram_counts;	/* [class][class] */
+static unsigned previous_class = PROFILE_CLASSES;
+
+/* A superinstruction is counted as its first instruction, and its
+   shadows as they are taken over, so the profile does not depend on
+   which superinstructions are in use. */
+static const int superinstr_head[64] = {
+  [0 ... 63] = -1,
+#define SUPERINSTR_HEADS
+#include "superinstr-loop.h"
+#undef SUPERINSTR_HEADS
+};
+
+
+void
+profile_instruction(unsigned op, unsigned arg)
+{
+  unsigned class;
+
+  if (superinstr_head[op] >= 0)
+    op = superinstr_head[op];
+
+  instr_counts[op * 256 + arg] += 1;
+
+  class = PROFILE_CLASS(op, arg);
+  if (previous_class < PROFILE_CLASSES)
+    bigram_counts[previous_class * PROFILE_CLASSES + class] += 1;
+  previous_class = class;
+}
+
+
+static void
+dump_instruction_profile(void)
+{
+  FILE *f = fopen(profile_file_name, WRITE_MODE);
+  unsigned long total = 0;
+  unsigned i, j;
+
+  if (f == NULL)
+    {
+      fprintf(stderr, "Unable to open instruction profile file %s.\n",
+	      profile_file_name);
+      return;
+    }
+
+  for (i = 0; i < 64 * 256; i++)
+    total += instr_counts[i];
+
+  fprintf(f, ";;; Oaklisp instruction profile.\n"
+	  ";;; (instruction OP ARG COUNT)\n"
+	  ";;; (bigram OP1 ARG1 OP2 ARG2 COUNT), ARGn is -1 if arged.\n\n");
+  fprintf(f, "(instructions %lu)\n", total);
+
+  for (i = 0; i < 64 * 256; i++)
+    if (instr_counts[i])
+      fprintf(f, "(instruction %u %u %lu)\n",
+	      i / 256, i % 256, instr_counts[i]);
+
+  for (i = 0; i < PROFILE_CLASSES; i++)
+    for (j = 0; j < PROFILE_CLASSES; j++)
+      {
+	unsigned long n = bigram_counts[i * PROFILE_CLASSES + j];
+
+	if (n)
+	  fprintf(f, "(bigram %u %d %u %d %lu)\n",
+		  i < 256 ? 0 : i - 256, i < 256 ? (int)i : -1,
+		  j < 256 ? 0 : j - 256, j < 256 ? (int)j : -1,
+		  n);
+      }
+
+  fclose(f);
+}
+
+
+void
+init_instruction_profile(void)
+{
+  instr_counts =
+    (unsigned long *)xmalloc(64 * 256 * sizeof(unsigned long));
+  bigram_counts =
+    (unsigned long *)xmalloc(PROFILE_CLASSES * PROFILE_CLASSES
+			     * sizeof(unsigned long));
+  memset(instr_counts, 0, 64 * 256 * sizeof(unsigned long));
+  memset(bigram_counts, 0,
+	 PROFILE_CLASSES * PROFILE_CLASSES * sizeof(unsigned long));
+
+  atexit(dump_instruction_profile);
+}
+
+#endif
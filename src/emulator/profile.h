@@ -0,0 +1,32 @@
+// This file is part of Oaklisp.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// The GNU GPL is available at http://www.gnu.org/licenses/gpl.html
+// or from the Free Software Foundation, 59 Temple Place - Suite 330,
+// Boston, MA 02111-1307, USA
+
+
+#ifndef _PROFILE_H_INCLUDED
+#define _PROFILE_H_INCLUDED
+
+#include "config.h"
+
+#ifdef PROFILE_INSTRUCTIONS
+
+extern char *profile_file_name;
+
+extern void init_instruction_profile(void);
+extern void profile_instruction(unsigned op_field, unsigned arg_field);
+
+#endif
+
+#endif
@@ -20,12 +20,28 @@
 
 #include "stacks.h"
 
+/* With TOS_CACHING the top of the value stack is kept in local_tos
+   instead of at *local_value_sp, which holds a stale value.  Everything
+   below it is in the buffer as usual.  It is spilled into the buffer
+   whenever the stack is unlocalized, so the gc, stack flushing and the
+   rest of the world outside loop() never see the difference. */
+
+#ifdef TOS_CACHING
+#define SPILL_TOS()	{ *local_value_sp = local_tos; }
+#define FILL_TOS()	{ local_tos = *local_value_sp; }
+#else
+#define SPILL_TOS()
+#define FILL_TOS()
+#endif
+
 #define LOCALIZE_VAL()					\
 {	local_value_sp = value_stack.sp;		\
+	FILL_TOS();					\
 }
 
 #define UNLOCALIZE_VAL()				\
-{	value_stack.sp = local_value_sp;		\
+{	SPILL_TOS();					\
+	value_stack.sp = local_value_sp;		\
 }
 
 #define LOCALIZE_CXT()					\
@@ -111,17 +127,44 @@
 /* The top of stack is always visible.
    Therefore PEEKVAL() can be used as an lvalue. */
 
+#ifdef TOS_CACHING
+#define PEEKVAL()	(local_tos)
+#else
 #define PEEKVAL()	(*local_value_sp)
+#endif
 
 /* When you are sure that the buffer has enough elements in it,
-   use this for looking deeper into the stack */
+   use this for looking deeper into the stack.  x must not be 0. */
 #define PEEKVAL_UP(x)	(*(local_value_sp-(x)))
 
 /* Use these when you are sure that overflows and underflows cannot occur. */
+#ifdef TOS_CACHING
+#define PUSHVAL_NOCHECK(r)  { ref_t _r = (r);				\
+			      *local_value_sp++ = local_tos;		\
+			      local_tos = _r; }
+#define POPVAL_NOCHECK()    ({ ref_t _v = local_tos;			\
+			       local_tos = *--local_value_sp;		\
+			       _v; })
+#else
 #define PUSHVAL_NOCHECK(r)  { *++local_value_sp = (r); }
 #define POPVAL_NOCHECK()    (*local_value_sp--)
+#endif
 
 
+#ifdef TOS_CACHING
+#define PUSHVAL(r)					\
+{							\
+  if (local_value_sp+1 < value_stack_end)		\
+    { PUSHVAL_NOCHECK(r); }				\
+  else {						\
+        GC_MEMORY(r);					\
+	VALUE_FLUSH(value_stack.filltarget);		\
+	SPILL_TOS();					\
+	local_value_sp++;				\
+	GC_RECALL(local_tos);				\
+  }							\
+}
+#else
 #define PUSHVAL(r)					\
 {							\
   if (local_value_sp+1 < value_stack_end)		\
@@ -132,6 +175,7 @@
 	GC_RECALL(*++local_value_sp);			\
   }							\
 }
+#endif
 
 #define PUSHVAL_IMM(r)					\
 {							\
@@ -142,7 +186,7 @@
 #define POPVAL(v)					\
 {							\
 	CHECKVAL_POP(1);				\
-	(v) = *local_value_sp--;			\
+	(v) = POPVAL_NOCHECK();				\
 }
 
 /* The following routines check that n elements can be pushed
@@ -181,7 +225,10 @@
    and then pops them off.  A better thing should be written.  */
 #define POPVALS(n)						\
 {	CHECKVAL_POP((n));					\
-	local_value_sp -= (n);					\
+	if ((n) != 0) {						\
+	  local_value_sp -= (n);				\
+	  FILL_TOS();						\
+	}							\
 }
 
 #define POPCXTS(n)						\
@@ -223,9 +270,26 @@
 	POPCXTS(to_pop);					\
 }
 
+/* The pointer may be to the top of stack, so with TOS_CACHING it is
+   spilled first; anyone storing through the pointer at distance 0
+   must follow with FILL_TOS(). */
 #define MAKE_BACK_VAL_PTR(v,dist)			\
 {	CHECKVAL_POP((dist));				\
+	SPILL_TOS();					\
 	(v) = local_value_sp - (dist);			\
 }
 
+/* Empty the buffer and push v. */
+#ifdef TOS_CACHING
+#define RESET_VALUE_STACK(v)				\
+{	local_value_sp = value_stack_bp;		\
+	local_tos = (v);				\
+}
+#else
+#define RESET_VALUE_STACK(v)				\
+{	local_value_sp = value_stack_bp;		\
+	*local_value_sp = (v);				\
+}
+#endif
+
 #endif
@@ -75,6 +75,9 @@ stack_flush(oakstack * stack_p, int amount_to_leave)
   int amount_unflushed = amount_to_flush;
   ref_t *src = stack_p->bp;
   ref_t *end = stack_p->sp - amount_to_leave;
+#if defined(TLABS) || (defined(THREADS) && defined(ALLOCATION_PROFILE))
+  int my_index = *(int *)pthread_getspecific(index_key);
+#endif
 
   /* flush everything between src & end, them move portion of buffer
      after end down to beginning of buffer. */
@@ -0,0 +1,364 @@
+// Automatically generated by instruction-table.oak
+
+#if defined(SUPERINSTR_HEADS)
+
+	[35] = 16,
+	[36] = 16,
+	[37] = 16,
+	[38] = 0,
+	[39] = 16,
+	[40] = 16,
+	[41] = 10,
+	[42] = 12,
+	[43] = 7,
+	[44] = 16,
+	[45] = 16,
+	[46] = 0,
+	[47] = 7,
+	[48] = 16,
+	[49] = 10,
+	[50] = 12,
+
+#elif defined(SUPERINSTR_SHADOWS)
+
+	[35] = { 65535, 10240 },	/* CAR */
+	[36] = { 255, 64 },	/* LOAD-STK */
+	[37] = { 65535, 768 },	/* EQ? */
+	[38] = { 255, 16 },	/* BRANCH-NIL */
+	[39] = { 255, 20 },	/* BRANCH-T */
+	[40] = { 255, 16 },	/* BRANCH-NIL */
+	[41] = { 255, 64 },	/* LOAD-STK */
+	[42] = { 255, 64 },	/* LOAD-STK */
+	[43] = { 255, 48 },	/* LOAD-BP */
+	[44] = { 65535, 10496 },	/* CDR */
+	[45] = { 255, 40 },	/* LOAD-IMM-FIX */
+	[46] = { 255, 64 },	/* LOAD-STK */
+	[47] = { 255, 64 },	/* LOAD-STK */
+	[48] = { 65535, 8448 },	/* < */
+	[49] = { 255, 40 },	/* LOAD-IMM-FIX */
+	[50] = { 65535, 6144 },	/* RETURN */
+
+#elif defined(SUPERINSTR_DISPATCH)
+
+	[35] = &&arged_35,
+	[36] = &&arged_36,
+	[37] = &&arged_37,
+	[38] = &&arged_38,
+	[39] = &&arged_39,
+	[40] = &&arged_40,
+	[41] = &&arged_41,
+	[42] = &&arged_42,
+	[43] = &&arged_43,
+	[44] = &&arged_44,
+	[45] = &&arged_45,
+	[46] = &&arged_46,
+	[47] = &&arged_47,
+	[48] = &&arged_48,
+	[49] = &&arged_49,
+	[50] = &&arged_50,
+
+#else
+
+	    ARGED_CASE(35):		/* LOAD-STK/CAR/LOAD-STK */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      GOTO_TOP;
+
+	    ARGED_CASE(36):		/* LOAD-STK/LOAD-STK/CAR */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      GOTO_TOP;
+
+	    ARGED_CASE(37):		/* LOAD-STK/EQ?/BRANCH-NIL */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(3))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POPVAL(x);
+	      PEEKVAL() = BOOL_TO_REF(x == PEEKVAL());
+	      if (!NEXT_IS_ARGED(4))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      POPVAL(x);
+	      if (x == e_nil)
+	        local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(38):		/* EQ?/BRANCH-NIL */
+	      POPVAL(x);
+	      PEEKVAL() = BOOL_TO_REF(x == PEEKVAL());
+	      if (!NEXT_IS_ARGED(4))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      POPVAL(x);
+	      if (x == e_nil)
+	        local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(39):		/* LOAD-STK/BRANCH-T */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(5))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      POPVAL(x);
+	      if (x != e_nil)
+	        local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(40):		/* LOAD-STK/BRANCH-NIL */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(4))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      POPVAL(x);
+	      if (x == e_nil)
+	        local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(41):		/* LOAD-IMM-FIX/LOAD-STK/CAR */
+	      PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      GOTO_TOP;
+
+	    ARGED_CASE(42):		/* LOAD-BP/LOAD-STK/CAR */
+	      x = *(e_bp + arg_field);
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      GOTO_TOP;
+
+	    ARGED_CASE(43):		/* POP/LOAD-BP/LOAD-STK */
+	      POPVALS(arg_field);
+	      if (!NEXT_IS_ARGED(12))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      x = *(e_bp + arg_field);
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      GOTO_TOP;
+
+	    ARGED_CASE(44):		/* LOAD-STK/CDR/BRANCH */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(41))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = cdr(PEEKVAL());
+	      if (!NEXT_IS_ARGED(6))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(45):		/* LOAD-STK/LOAD-IMM-FIX/LOAD-STK */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGED(10))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      GOTO_TOP;
+
+	    ARGED_CASE(46):		/* EQ?/LOAD-STK/CAR */
+	      POPVAL(x);
+	      PEEKVAL() = BOOL_TO_REF(x == PEEKVAL());
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      GOTO_TOP;
+
+	    ARGED_CASE(47):		/* POP/LOAD-STK/CAR */
+	      POPVALS(arg_field);
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(40))
+		GOTO_TOP;
+	      if (!(TAG_IS(PEEKVAL(), PTR_TAG) && REF_SLOT(PEEKVAL(), 0) == e_cons_type))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PEEKVAL() = car(PEEKVAL());
+	      GOTO_TOP;
+
+	    ARGED_CASE(48):		/* LOAD-STK/</BRANCH-NIL */
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(33))
+		GOTO_TOP;
+	      CHECKVAL_POP(1);
+	      if (!(((PEEKVAL() | PEEKVAL_UP(1)) & TAG_MASK) == 0))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POPVAL(x);
+	      PEEKVAL() = BOOL_TO_REF((long)x < (long)PEEKVAL());
+	      if (!NEXT_IS_ARGED(4))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POLL_SIGNALS();
+	      POPVAL(x);
+	      if (x == e_nil)
+	        local_epc += signed_arg_field;
+	      GOTO_TOP;
+
+	    ARGED_CASE(49):		/* LOAD-IMM-FIX/LOAD-IMM-FIX/LOAD-STK */
+	      PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
+	      if (!NEXT_IS_ARGED(10))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      PUSHVAL_IMM(INT_TO_REF(signed_arg_field));
+	      if (!NEXT_IS_ARGED(16))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      {
+	        ref_t *other;
+	        MAKE_BACK_VAL_PTR(other, arg_field);
+	        x = *other;
+	      }
+	      PUSHVAL(x);
+	      GOTO_TOP;
+
+	    ARGED_CASE(50):		/* LOAD-BP/RETURN */
+	      x = *(e_bp + arg_field);
+	      PUSHVAL(x);
+	      if (!NEXT_IS_ARGLESS(24))
+		GOTO_TOP;
+	      TAKE_SHADOW();
+	      POP_CONTEXT();
+	      ENTER_CODE_SEGMENT();
+	      GOTO_TOP;
+
+#endif
@@ -26,19 +26,32 @@
 #include "stacks.h"
 #include "loop.h"
 #include "gc.h"
+#include "mcache.h"
+#include "allocprof.h"
+#include "timers.h"
 
 #ifdef THREADS
 int next_index = 0;
 pthread_key_t index_key;
-pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t test_and_set_locative_lock = PTHREAD_MUTEX_INITIALIZER;
-bool gc_pending = false;
-int gc_ready[MAX_THREAD_COUNT];
+volatile bool gc_pending = false;
 register_set_t* register_array[MAX_THREAD_COUNT];
 oakstack *value_stack_array[MAX_THREAD_COUNT];
 oakstack *cntxt_stack_array[MAX_THREAD_COUNT];
+
+/* Safepoints.  A thread that wants to gc sets gc_pending and sleeps on
+   safepoint_arrival until every other running thread has noticed it
+   at a safepoint and counted itself in stopped_count.  Those sleep on
+   safepoint_release until the gc is over and safepoint_epoch moves
+   on.  All of this is under safepoint_lock. */
+static pthread_mutex_t safepoint_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t safepoint_arrival = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t safepoint_release = PTHREAD_COND_INITIALIZER;
+static int running_count = 0;	/* threads that must stop */
+static int stopped_count = 0;
+static unsigned long safepoint_epoch = 0;
 #endif
 
 #ifdef THREADS
@@ -68,14 +81,17 @@ int create_thread(ref_t start_operation)
 	     MAX_THREAD_COUNT);
     return 0;
   }
-  gc_ready[index] = 0;
   info_p->start_operation = start_operation;
   info_p->parent_index = *((int *)pthread_getspecific(index_key));
   info_p->my_index = index;
   if (pthread_create(&new_thread, NULL,
 		     (void *)init_thread, (void *)info_p))
-    // Error creating --- need to add some clean up code here !!!
-    return 0;
+    {
+      // Error creating --- need to add some clean up code here !!!
+      free(info_p);
+      thread_exited();
+      return 0;
+    }
   else
     return 1;
 #else
@@ -98,6 +114,10 @@ static void *init_thread (void *info_p)
   *my_index_p = info.my_index;
   my_index = *my_index_p;
   pthread_setspecific(index_key, (void *)my_index_p);
+
+#if defined(CALL_SITE_CACHE) || defined(METHOD_TABLE)
+  init_method_caches();
+#endif
   /* Increment also releases the gc lock on next_index so another
      starting thread can get the lock, or a thread that is gc'ing can
      get the lock */
@@ -119,6 +139,12 @@ static void *init_thread (void *info_p)
 
   memcpy(register_array[my_index], register_array[info.parent_index],
 	 sizeof(register_set_t));
+#ifdef TLABS
+  reg_set->tlab_point = reg_set->tlab_end = NULL;
+#endif
+#ifdef ALLOCATION_PROFILE
+  reg_set->alloc_countdown = ALLOCATION_COUNTDOWN();
+#endif
 
   gc_examine_ptr = gc_examine_buffer;
 
@@ -129,33 +155,69 @@ static void *init_thread (void *info_p)
   /* Big virtual machine interpreter loop */
   loop(info.start_operation);
 
+  thread_exited();
   return 0;
 }
-#endif
 
-void set_gc_flag (bool flag)
+/* Sleep at a safepoint until the gc that is pending is over.  Called
+   with safepoint_lock held. */
+static void
+park_at_safepoint(void)
 {
-#ifdef THREADS
-  int *my_index_p;
-  int  my_index;
-  my_index_p = pthread_getspecific (index_key);
-  my_index = *(my_index_p);
+  unsigned long epoch = safepoint_epoch;
 
-  if (flag == true) {
-    pthread_mutex_lock (&gc_lock);
-    gc_pending = flag;
-  }
-  else {
-    gc_pending = flag;
-    pthread_mutex_unlock (&gc_lock);
-  }
-#endif
+  stopped_count += 1;
+  pthread_cond_signal(&safepoint_arrival);
+  while (safepoint_epoch == epoch)
+    pthread_cond_wait(&safepoint_release, &safepoint_lock);
 }
 
-/* Increment uses the gc lock since we must be sure that a new thread
-   does not get started and begin processing while the gc is already
-   running.  The get_next_index additionally ensures that no two
-   threads get the same index when starting */
+/* Stop every other thread at a safepoint, first waiting out any gc
+   another thread has begun.  Returns how many milliseconds it took. */
+unsigned long
+stop_the_world(void)
+{
+  unsigned long start = get_real_time();
+
+  pthread_mutex_lock(&safepoint_lock);
+  while (gc_pending)
+    park_at_safepoint();
+  gc_pending = true;
+  while (stopped_count < running_count - 1)
+    pthread_cond_wait(&safepoint_arrival, &safepoint_lock);
+  pthread_mutex_unlock(&safepoint_lock);
+
+  return get_real_time() - start;
+}
+
+/* Let the threads stop_the_world() stopped run again. */
+void
+start_the_world(void)
+{
+  pthread_mutex_lock(&safepoint_lock);
+  gc_pending = false;
+  stopped_count = 0;
+  safepoint_epoch += 1;
+  pthread_cond_broadcast(&safepoint_release);
+  pthread_mutex_unlock(&safepoint_lock);
+}
+
+/* A thread that has stopped running, or failed to start, no longer
+   has to be waited for at safepoints. */
+void
+thread_exited(void)
+{
+  pthread_mutex_lock(&safepoint_lock);
+  running_count -= 1;
+  pthread_cond_signal(&safepoint_arrival);
+  pthread_mutex_unlock(&safepoint_lock);
+}
+#endif
+
+/* Once a thread has its index it must be waited for at safepoints, so
+   if a gc is stopping the world meanwhile it waits for the new thread
+   to reach its first one.  The get_next_index additionally ensures
+   that no two threads get the same index when starting */
 
 int get_next_index ()
 {
@@ -167,12 +229,52 @@ int get_next_index ()
   } else {
     ret = next_index;
     next_index++;
+    pthread_mutex_lock(&safepoint_lock);
+    running_count += 1;
+    pthread_mutex_unlock(&safepoint_lock);
   }
   pthread_mutex_unlock (&index_lock);
 #endif
   return (ret);
 }
 
+#ifdef TLABS
+/* Called with alloc_lock held to allocate words for the thread with
+   registers regs once its allocation buffer is used up.  Unless they are
+   too many to come out of a buffer, it is given a new one.  Returns
+   false if new space is too full. */
+bool
+tlab_refill(register_set_t * regs, ref_t ** pp, long words)
+{
+  long size = words > TLAB_SIZE / 4 ? words : TLAB_SIZE;
+
+  if (free_point + size >= new_space.end)
+    return false;
+
+  *pp = free_point;
+  free_point += size;
+  if (size != words)
+    {
+      tlab_retire(regs);
+      regs->tlab_point = *pp + words;
+      regs->tlab_end = *pp + size;
+    }
+  return true;
+}
+
+/* Give up the unused end of an allocation buffer, filling it with
+   fixnums as the gc scans new space word by word. */
+void
+tlab_retire(register_set_t * regs)
+{
+  ref_t *p;
+
+  for (p = regs->tlab_point; p < regs->tlab_end; p++)
+    *p = INT_TO_REF(0);
+  regs->tlab_point = regs->tlab_end = NULL;
+}
+#endif
+
 void free_registers ()
 {
 }
@@ -180,13 +282,9 @@ void free_registers ()
 void wait_for_gc()
 {
 #ifdef THREADS
-  int *my_index_p;
-  int  my_index;
-  my_index_p = pthread_getspecific (index_key);
-  my_index = *(my_index_p);
-  gc_ready[my_index] = 1;
-  pthread_mutex_lock (&gc_lock);
-  gc_ready[my_index] = 0;
-  pthread_mutex_unlock (&gc_lock);
+  pthread_mutex_lock(&safepoint_lock);
+  if (gc_pending)
+    park_at_safepoint();
+  pthread_mutex_unlock(&safepoint_lock);
 #endif
 }
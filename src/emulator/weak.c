@@ -26,6 +26,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "config.h"
 #include "data.h"
 #include "xmalloc.h"
@@ -35,36 +36,47 @@
 
 /*
  * Weak pointers are done with a simple table that goes from weak
- * pointers to objects, and a hash table that goes from objects to
- * their weak pointers.
+ * pointers to objects, and hash tables that go from objects to their
+ * weak pointers.
 
- * In the future, this will be modified to keep separate hash tables
- * for the different areas, so that objects in spatic space need not
- * be rehashed.
+ * There are separate hash tables for the different areas, so that
+ * objects in spatic space need not be rehashed: one for objects in
+ * spatic space, which is only touched by a full gc, one for all other
+ * objects, and one for unboxed values like fixnums, which never move.
+ * The weak pointers of the objects in the second are kept in a list,
+ * the young list, which is all a gc that is not full looks at.
 
- * Plus another one for unboxed values like fixnums.
+ * The table and the hash tables start small and double when they fill
+ * up.  Weak pointers are never reused, since their numbers may be held
+ * onto after their objects die, so the table only ever grows.
 
  */
 
+#define WP_TABLE_INITIAL_SIZE 3000
+#define WP_HASHTABLE_INITIAL_SIZE 1024	/* must be a power of two */
 
-const int wp_table_size = 3000;
-const int wp_hashtable_size = 3017;
+unsigned long wp_table_size;	/* room in wp_table, not counting [0] */
 
 
 ref_t *wp_table;		/* wp -> ref */
 int wp_index = 0;		/* number of entries in wp_table */
 
 
-/* A hash table from references to their weak pointers.  This hash
- * table is not saved in dumped worlds, and is rebuilt from scratch
- * after each GC and upon booting a new world.
+/* Hash tables from references to their weak pointers.  These hash
+ * tables are not saved in dumped worlds.  They are built from scratch
+ * upon booting a new world and after a full GC.  After other GCs the
+ * entries of objects that moved or died are deleted, and those that
+ * moved are entered again.
 
- * Structure of this hash table:
+ * Structure of these hash tables:
 
  * Keys are references themselves, smashed about and xored if deemed
  * necessary.
 
- * Sequential rehash, single probe.
+ * Sequential rehash, single probe.  The load factor is kept under one
+ * half.  There are no tombstones: deleting an entry moves the entries
+ * after it in its cluster back into the hole if that brings them no
+ * further from their home slots.
  */
 
 
@@ -75,54 +87,249 @@ typedef struct
   }
 wp_hashtable_entry;
 
-wp_hashtable_entry *wp_hashtable;
+typedef struct
+  {
+    wp_hashtable_entry *entries;
+    unsigned long mask;
+    unsigned long count;	/* entries in use */
+  }
+wp_hashtable_t;
+
+enum
+{ WP_IMMEDIATE, WP_SPATIC, WP_YOUNG, WP_HASHTABLES };
+
+static wp_hashtable_t wp_hashtables[WP_HASHTABLES];
+
+#define wp_area(r)					\
+  ( ((r) & PTR_MASK) == 0 ? WP_IMMEDIATE :		\
+    SPATIC_PTR(ANY_TO_PTR(r)) ? WP_SPATIC : WP_YOUNG )
+
+
+/* A growable list of weak pointer numbers. */
+typedef struct
+  {
+    long *wps;
+    unsigned long count, size;
+  }
+wp_list_t;
+
+/* The weak pointers in the young hash table. */
+static wp_list_t wp_young;
+
+/* Weak pointers whose objects moved in the last gc, and are in no
+   hash table.  Until the gc is over it is not known which areas they
+   are in, so they are entered lazily, by settle_wps(). */
+static wp_list_t wp_moved;
+
+/* True if the last gc was full, and none are in the hash tables. */
+static bool wp_stale = false;
+
+
+static void
+wp_list_add(wp_list_t * l, long wp)
+{
+  if (l->count == l->size)
+    {
+      long *old = l->wps;
+
+      l->size = l->size ? 2 * l->size : 256;
+      l->wps = (long *)xmalloc(l->size * sizeof(long));
+      if (old)
+	{
+	  memcpy(l->wps, old, l->count * sizeof(long));
+	  free(old);
+	}
+    }
+  l->wps[l->count++] = wp;
+}
 
 
 
 /* The following magic number is floor( 2^32 * (sqrt(5)-1)/2 ). */
-#define wp_key(r) ((unsigned long) 0x9E3779BB*(r))	/* >>10, == 2654435771L */
+#define wp_key(r) \
+  ((unsigned long)((u_int32_t)(r) * 0x9E3779BBu) >> 4)	/* == 2654435771L */
 
+#define wp_home(h,r) (wp_key(r) & (h)->mask)
+
+
+static void
+grow_wp_table(unsigned long size)
+{
+  ref_t *old = wp_table;
+
+  wp_table = (ref_t *) xmalloc((size + 1) * sizeof(ref_t));
+  if (old)
+    {
+      memcpy(wp_table, old, (1 + wp_index) * sizeof(ref_t));
+      free(old);
+    }
+  wp_table_size = size;
+}
+
+/* Make room for count weak pointers, as when loading a world. */
 void
-init_weakpointer_tables(void)
+reserve_wp_table(unsigned long count)
 {
-  wp_table = (ref_t *) xmalloc((wp_table_size + 1) * sizeof(ref_t));
-  wp_hashtable =
-    (wp_hashtable_entry *) xmalloc(sizeof(wp_hashtable_entry)
-				   * wp_hashtable_size);
+  if (count > wp_table_size)
+    grow_wp_table(count > 2 * wp_table_size ? count : 2 * wp_table_size);
 }
 
 
-/* Register r as having weak pointer wp. */
+/* Register r as having weak pointer wp.  There must be room. */
 static void
-enter_wp(ref_t r, ref_t wp)
+enter_wp(wp_hashtable_t * h, ref_t r, ref_t wp)
 {
-  long i = wp_key(r) % wp_hashtable_size;
+  unsigned long i = wp_home(h, r);
 
-  while (1)			/* forever */
-    if (wp_hashtable[i].obj == e_false)
-      {
-	wp_hashtable[i].obj = r;
-	wp_hashtable[i].wp = wp;
-	return;
-      }
-    else if (++i == wp_hashtable_size)
-      i = 0;
+  while (h->entries[i].obj != e_false)
+    i = (i + 1) & h->mask;
+  h->entries[i].obj = r;
+  h->entries[i].wp = wp;
+  h->count += 1;
+}
+
+/* Give h size empty slots. */
+static void
+clear_wp_hashtable(wp_hashtable_t * h, unsigned long size)
+{
+  unsigned long i;
+
+  if (h->mask + 1 != size || h->entries == NULL)
+    {
+      free(h->entries);
+      h->entries =
+	(wp_hashtable_entry *) xmalloc(sizeof(wp_hashtable_entry) * size);
+      h->mask = size - 1;
+    }
+  h->count = 0;
+
+  for (i = 0; i < size; i++)
+    h->entries[i].obj = e_false;
+}
+
+/* Double the size of h, keeping what is in it. */
+static void
+grow_wp_hashtable(wp_hashtable_t * h)
+{
+  wp_hashtable_entry *old = h->entries;
+  unsigned long i, old_size = h->mask + 1;
+
+  h->entries = NULL;
+  clear_wp_hashtable(h, 2 * old_size);
+  for (i = 0; i < old_size; i++)
+    if (old[i].obj != e_false)
+      enter_wp(h, old[i].obj, old[i].wp);
+  free(old);
+}
+
+/* Remove r from h.  It is not there if the tables have not been
+   built yet, as in a gc before e_nil is set. */
+static void
+remove_wp(wp_hashtable_t * h, ref_t r)
+{
+  unsigned long i = wp_home(h, r), j;
+
+  while (h->entries[i].obj != r)
+    if (h->entries[i].obj == e_false)
+      return;
+    else
+      i = (i + 1) & h->mask;
+
+  /* i is the hole.  Anything later in the cluster whose home is not
+     strictly between the hole and where it sits can be moved into the
+     hole, leaving a new hole behind it. */
+  for (j = (i + 1) & h->mask;
+       h->entries[j].obj != e_false; j = (j + 1) & h->mask)
+    {
+      unsigned long home = wp_home(h, h->entries[j].obj);
+
+      if (((j - home) & h->mask) >= ((j - i) & h->mask))
+	{
+	  h->entries[i] = h->entries[j];
+	  i = j;
+	}
+    }
+
+  h->entries[i].obj = e_false;
+  h->count -= 1;
+}
+
+/* Enter weak pointer wp, whose object is r, in the hash table for the
+   area r is in, making room if need be. */
+static void
+enter_wp_in_area(ref_t r, long wp)
+{
+  int area = wp_area(r);
+  wp_hashtable_t *h = &wp_hashtables[area];
+
+  if (2 * (h->count + 1) > h->mask + 1)
+    grow_wp_hashtable(h);
+  enter_wp(h, r, INT_TO_REF(wp));
+  if (area == WP_YOUNG)
+    wp_list_add(&wp_young, wp);
+}
+
+void
+init_weakpointer_tables(void)
+{
+  int i;
+
+  wp_table = NULL;
+  grow_wp_table(WP_TABLE_INITIAL_SIZE);
+  for (i = 0; i < WP_HASHTABLES; i++)
+    {
+      wp_hashtables[i].entries = NULL;
+      clear_wp_hashtable(&wp_hashtables[i], WP_HASHTABLE_INITIAL_SIZE);
+    }
 }
 
 
-/* Rebuild the weak pointer hash table from the information in the table
-   that takes weak pointers to objects. */
+/* Rebuild the weak pointer hash tables from the information in the
+   table that takes weak pointers to objects, making them big enough
+   for it. */
 void
 rebuild_wp_hashtable(void)
 {
   long i;
+  int area;
+  unsigned long counts[WP_HASHTABLES] = { 0 };
+
+  for (i = 0; i < wp_index; i++)
+    if (wp_table[1 + i] != e_false)
+      counts[wp_area(wp_table[1 + i])] += 1;
 
-  for (i = 0; i < wp_hashtable_size; i++)
-    wp_hashtable[i].obj = e_false;
+  for (area = 0; area < WP_HASHTABLES; area++)
+    {
+      unsigned long size = WP_HASHTABLE_INITIAL_SIZE;
+
+      while (2 * (counts[area] + 1) > size)
+	size *= 2;
+      clear_wp_hashtable(&wp_hashtables[area], size);
+    }
+
+  wp_young.count = 0;
+  wp_moved.count = 0;
+  wp_stale = false;
 
   for (i = 0; i < wp_index; i++)
     if (wp_table[1 + i] != e_false)
-      enter_wp(wp_table[1 + i], INT_TO_REF(i));
+      enter_wp_in_area(wp_table[1 + i], i);
+}
+
+/* Enter the weak pointers the last gc left out of the hash tables. */
+static void
+settle_wps(void)
+{
+  unsigned long i;
+
+  if (wp_stale)
+    rebuild_wp_hashtable();
+  else
+    {
+      for (i = 0; i < wp_moved.count; i++)
+	enter_wp_in_area(wp_table[1 + wp_moved.wps[i]], wp_moved.wps[i]);
+      wp_moved.count = 0;
+    }
 }
 
 
@@ -131,29 +338,37 @@ rebuild_wp_hashtable(void)
 ref_t
 ref_to_wp(ref_t r)
 {
-  long i;
+  wp_hashtable_t *h;
+  unsigned long i;
   ref_t temp;
 
   if (r == e_false)
     return INT_TO_REF(-1);
-  i = wp_key(r) % wp_hashtable_size;
+  if (wp_stale || wp_moved.count != 0)
+    settle_wps();
+
+  h = &wp_hashtables[wp_area(r)];
+  i = wp_home(h, r);
 
   while (1)			/* forever */
     {
-      temp = wp_hashtable[i].obj;
+      temp = h->entries[i].obj;
       if (temp == r)
 	{
-	  return wp_hashtable[i].wp;
+	  return h->entries[i].wp;
 	}
       else if (temp == e_false)
 	{
 	  /* Make a new weak pointer, installing it in both tables: */
-	  wp_hashtable[i].obj = wp_table[1 + wp_index] = r;
-	  return wp_hashtable[i].wp = INT_TO_REF(wp_index++);
+	  if ((unsigned long)wp_index + 1 > wp_table_size)
+	    grow_wp_table(2 * wp_table_size);
+	  wp_table[1 + wp_index] = r;
+	  enter_wp_in_area(r, wp_index);
+	  return INT_TO_REF(wp_index++);
 	}
-      else if (++i == wp_hashtable_size)
+      else
 	{
-	  i = 0;
+	  i = (i + 1) & h->mask;
 	}
     }
 }
@@ -162,23 +377,23 @@ ref_to_wp(ref_t r)
 
 #include <stdio.h>
 void
-wp_hashtable_distribution(void)
+wp_hashtable_distribution(wp_hashtable_t * h)
 {
   long i;
 
-  for (i = 0; i < wp_hashtable_size; i++)
+  for (i = 0; i <= h->mask; i++)
     {
-      ref r = wp_hashtable[i].obj;
+      ref r = h->entries[i].obj;
 
       if (r == e_false)
 	(void)putchar('.');
       else
 	{
-	  unsigned long j = wp_key(r) % wp_hastable_size;
+	  unsigned long j = wp_home(h, r);
 	  long dist = i - j;
 
 	  if (dist < 0)
-	    dist += wp_hastable_size;
+	    dist += h->mask + 1;
 
 	  if (dist < 1 + '9' - '0')
 	    (void)putchar((char)('0' + dist));
@@ -198,33 +413,49 @@ wp_hashtable_distribution(void)
 unsigned long
 post_gc_wp(void)
 {
-  /* Scan the weak pointer table.  When a reference to old space is
-     found, check if the location has a forwarding pointer.  If so,
-     update it; if not, discard it. */
-  long i;
-  unsigned long discard_count = 0;
+  /* Scan the weak pointer table.  Update the references to objects
+     that survived, and discard those to objects that did not.  A gc
+     that is not full only needs to look at the young list, and
+     deletes the entries of objects that moved or died from the young
+     hash table.  Those that moved are entered again once the gc is
+     over and it is known which areas they ended up in. */
+  unsigned long i, kept = 0, discard_count = 0;
+  wp_hashtable_t *h = &wp_hashtables[WP_YOUNG];
+
+  settle_wps();
+
+  if (full_gc)
+    {
+      for (i = 0; i < (unsigned long)wp_index; i++)
+	if (wp_table[1 + i] != e_false && !gc_forward(&wp_table[1 + i]))
+	  {
+	    wp_table[1 + i] = e_false;
+	    discard_count += 1;
+	  }
+      wp_stale = true;
+      return discard_count;
+    }
 
-  for (i = 0; i < wp_index; i++)
+  for (i = 0; i < wp_young.count; i++)
     {
-      ref_t r = wp_table[1 + i], *p;
+      long wp = wp_young.wps[i];
+      ref_t old = wp_table[1 + wp];
 
-      if ((r & PTR_MASK) && (p = ANY_TO_PTR(r), OLD_PTR(p)))
+      if (!gc_forward(&wp_table[1 + wp]))
 	{
-	  ref_t r1 = *p;
-
-	  if (TAG_IS(r1, LOC_TAG) && NEW_PTR(LOC_TO_PTR(r1)))
-	    {
-	      wp_table[1 + i] = TAG_IS(r, LOC_TAG) ? r1 : r1 | PTR_TAG;
-	    }
-	  else
-	    {
-	      wp_table[1 + i] = e_false;
-	      discard_count += 1;
-	    }
+	  wp_table[1 + wp] = e_false;
+	  remove_wp(h, old);
+	  discard_count += 1;
+	}
+      else if (wp_table[1 + wp] != old)
+	{
+	  remove_wp(h, old);
+	  wp_list_add(&wp_moved, wp);
 	}
+      else
+	wp_young.wps[kept++] = wp;
     }
-
-  rebuild_wp_hashtable();
+  wp_young.count = kept;
 
   return discard_count;
 }
@@ -29,12 +29,13 @@
 
 void init_weakpointer_tables(void);
 void rebuild_wp_hashtable(void);
+void reserve_wp_table(unsigned long count);
 ref_t ref_to_wp(ref_t r);
 extern unsigned long post_gc_wp(void);
 
-/* Weak pointer table and weak pointer hashtable */
+/* Weak pointer table */
 
-extern const int wp_table_size, wp_hashtable_size;
+extern unsigned long wp_table_size;
 extern ref_t *wp_table;
 extern int wp_index;
 
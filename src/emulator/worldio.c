@@ -33,6 +33,8 @@
 #include "xmalloc.h"
 #include "worldio.h"
 #include "weak.h"
+#include "idhash.h"
+#include "gc.h"
 
 
 void xfread(void *ptr, size_t size, size_t nmemb, FILE *stream)
@@ -60,6 +62,12 @@ void xfread(void *ptr, size_t size, size_t nmemb, FILE *stream)
  *
  * <size of weak pointer table>
  * <contents of weak pointer table>
+ *
+ * <number of identity hashes>
+ * <object and identity hash, for each>
+ *
+ * The identity hashes may be missing, as they are from cold load
+ * files and from worlds dumped before there were any.
  */
 
 
@@ -174,7 +182,8 @@ dump_binary_world(bool just_new)
 {
   FILE *wfp = 0;
   ref_t *memptr;
-  ref_t theref;
+  ref_t theref, hash;
+  unsigned long i = 0;
 
   /* CAUTION: STACK SPACE!!! */
 
@@ -247,6 +256,17 @@ dump_binary_world(bool just_new)
       fwrite((const void *)&theref, sizeof(ref_t), 1, wfp);
     }
 
+  /* Identity hashes. */
+  theref = (ref_t) identity_hash_count();
+  fwrite((const void *)&theref, sizeof(ref_t), 1, wfp);
+
+  while (next_identity_hash(&i, &theref, &hash))
+    {
+      CONTIGIFY(theref);
+      fwrite((const void *)&theref, sizeof(ref_t), 1, wfp);
+      fwrite((const void *)&hash, sizeof(ref_t), 1, wfp);
+    }
+
   fclose(wfp);
 }
 
@@ -254,8 +274,9 @@ dump_binary_world(bool just_new)
 static void
 dump_ascii_world(bool just_new)
 {
-  ref_t *memptr, theref;
+  ref_t *memptr, theref, hash;
   long i;
+  unsigned long j = 0;
   int eighter = 0;
   char *control_string = (dump_base == 10 ? "%ld " : "%lx ");
   FILE *wfp = 0;
@@ -313,6 +334,23 @@ dump_ascii_world(bool just_new)
       fprintf(wfp, control_string, theref);
       eighter = (eighter + 1) % 8;
     }
+  fprintf(wfp, "\n");
+
+  /* Write the identity hashes. */
+
+  fprintf(wfp, control_string, identity_hash_count());
+
+  eighter = 0;
+
+  while (next_identity_hash(&j, &theref, &hash))
+    {
+      if (eighter == 0)
+	fprintf(wfp, "\n");
+      CONTIGIFY(theref);
+      fprintf(wfp, control_string, theref);
+      fprintf(wfp, control_string, hash);
+      eighter = (eighter + 1) % 4;
+    }
 
   fclose(wfp);
 }
@@ -327,6 +365,23 @@ dump_world(bool just_new)
     dump_ascii_world(just_new);
 }
 
+/* True if there is nothing left to read but white space. */
+static bool
+at_end_of_world(FILE * d)
+{
+  int c;
+
+  if (input_is_binary)
+    c = getc(d);
+  else
+    while (isspace(c = getc(d)))
+      ;
+  if (c == EOF)
+    return true;
+  ungetc(c, d);
+  return false;
+}
+
 static void
 reoffset(ref_t baseAddr,
 	 ref_t * start,
@@ -381,7 +436,7 @@ read_world(char *str)
   e_boot_code = read_ref(d);
 
   spatic.size = (size_t) read_ref(d);
-  alloc_space(&spatic, spatic.size);
+  alloc_spatic(spatic.size);
 
   e_boot_code += (ref_t) spatic.start;
 
@@ -410,13 +465,7 @@ read_world(char *str)
     /* Load the weak pointer table. */
     wp_index = read_ref(d);
 
-    if (wp_index + 1 > wp_table_size)
-      {
-	fprintf(stderr,
-		"Error (loading world): number of weak pointers in world"
-		" exceeds internal table size.\n");
-	exit(EXIT_FAILURE);
-      }
+    reserve_wp_table(wp_index);
 
     load_count = wp_index;
     mptr = &wp_table[1];
@@ -435,8 +484,21 @@ read_world(char *str)
 	  *mptr++ = next;
 	  --load_count;
 	}
+
+    /* Load the identity hashes. */
+    if (!at_end_of_world(d))
+      for (load_count = read_ref(d); load_count != 0; load_count--)
+	{
+	  ref_t hash;
+
+	  next = read_ref(d);
+	  if (next & 2)
+	    next += (ref_t) spatic.start;
+	  hash = read_ref(d);
+	  load_identity_hash(next, hash);
+	}
   }
 
-  /* The weak pointer hash table is rebuilt when e_nil is set. */
+  /* The weak pointer hash tables are rebuilt when e_nil is set. */
   fclose(d);
 }
@@ -32,6 +32,11 @@
 #include "data.h"
 #include "xmalloc.h"
 
+#ifdef MMAP_SPACES
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 
 
@@ -54,6 +59,190 @@ xmalloc(size_t size)
     }
 }
 
+#ifdef MMAP_SPACES
+/*
+ * The spaces of the heap are mapped, each in a mapping of its own.  When
+ * the gc lets go of a space its pages are given back to the system but
+ * the mapping is kept, and the next space that fits is put there, so a
+ * gc flipping between two semispaces maps nothing after the first few.
+ * Big mappings are rounded to and asked for in huge pages.
+ */
+
+#ifndef SPACE_CACHE_SIZE
+#define SPACE_CACHE_SIZE 4	/* idle mappings kept */
+#endif
+
+#define MAX_MAPPINGS (SPACE_CACHE_SIZE + 8)
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+typedef struct
+{
+  char *start;			/* 0 if the slot is empty */
+  size_t capacity;		/* in bytes */
+  bool in_use;
+} mapping_t;
+
+static mapping_t mappings[MAX_MAPPINGS];
+
+static mapping_t *
+find_mapping(void *start)
+{
+  int i;
+
+  for (i = 0; i < MAX_MAPPINGS; i++)
+    if (mappings[i].start == start)
+      return &mappings[i];
+  return NULL;
+}
+
+static void
+unmap(mapping_t * m)
+{
+  munmap(m->start, m->capacity);
+  m->start = 0;
+  m->capacity = 0;
+  m->in_use = false;
+}
+
+/* Give the pages of len bytes from start back to the system; what they
+   hold need not be kept. */
+static void
+release_pages(char *start, size_t len)
+{
+#ifdef HAVE_MADVISE
+  size_t page = sysconf(_SC_PAGESIZE);
+  char *p = (char *)(((unsigned long)start + page - 1) & ~(page - 1));
+
+  if (p >= start + len)
+    return;
+  len = (start + len - p) & ~(page - 1);
+#ifdef MADV_FREE
+  if (madvise(p, len, MADV_FREE) == 0)
+    return;
+#endif
+  madvise(p, len, MADV_DONTNEED);
+#endif
+}
+
+/* Give back the pages of size words from start, which are no longer
+   used. */
+void
+release_space_pages(ref_t * start, size_t size)
+{
+  release_pages((char *)start, sizeof(ref_t) * size);
+}
+
+void
+alloc_space(space_t * pspace, size_t size_requested)
+{
+  /* size_requested measures references */
+  size_t bytes = sizeof(ref_t) * size_requested;
+  size_t granule;
+  mapping_t *m = NULL;
+  int i;
+
+  /* Reuse the smallest idle mapping that is big enough. */
+  for (i = 0; i < MAX_MAPPINGS; i++)
+    if (mappings[i].start && !mappings[i].in_use
+	&& mappings[i].capacity >= bytes
+	&& (m == NULL || mappings[i].capacity < m->capacity))
+      m = &mappings[i];
+
+  if (m == NULL)
+    {
+      void *ptr;
+
+      /* Spaces tend to grow, so idle ones too small for this one are
+	 not likely to be used again. */
+      for (i = 0; i < MAX_MAPPINGS; i++)
+	if (mappings[i].start && !mappings[i].in_use)
+	  unmap(&mappings[i]);
+
+      m = find_mapping(0);
+      if (m == NULL)
+	{
+	  fprintf(stderr, "ERROR(alloc_space): Too many spaces.\n");
+	  exit(EXIT_FAILURE);
+	}
+
+      granule = bytes >= HUGE_PAGE_SIZE
+	? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+      m->capacity = (bytes + granule - 1) & ~(granule - 1);
+      ptr = mmap(NULL, m->capacity, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (ptr == MAP_FAILED)
+	{
+	  fprintf(stderr,
+		  "ERROR(alloc_space): Unable to map %lu bytes.\n",
+		  (unsigned long)m->capacity);
+	  exit(EXIT_FAILURE);
+	}
+      m->start = (char *)ptr;
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+      if (granule == HUGE_PAGE_SIZE)
+	madvise(ptr, m->capacity, MADV_HUGEPAGE);
+#endif
+    }
+
+  m->in_use = true;
+  pspace->start = (ref_t *) m->start;
+  pspace->size = size_requested;
+  pspace->end = pspace->start + size_requested;
+}
+
+
+void
+free_space(space_t * pspace)
+{
+  mapping_t *m = find_mapping(pspace->start);
+  int i, idle = 0;
+
+  assert(m != NULL && m->in_use);
+  for (i = 0; i < MAX_MAPPINGS; i++)
+    if (mappings[i].start && !mappings[i].in_use)
+      idle += 1;
+  if (idle < SPACE_CACHE_SIZE)
+    {
+      release_pages(m->start, m->capacity);
+      m->in_use = false;
+    }
+  else
+    unmap(m);
+
+  pspace->start = pspace->end = 0;
+  pspace->size = 0;
+}
+
+
+/* This is called during a full GC to convert the old new space to the
+   new spatic space.  Any unallocated new space is trimmed, so this
+   should be decreasing the size, or at worst leaving it the same. */
+void
+realloc_space(space_t * pspace, size_t size_requested)
+{
+  mapping_t *m = find_mapping(pspace->start);
+  size_t bytes = sizeof(ref_t) * size_requested;
+
+  if (pspace->start == NULL || m == NULL)
+    {
+      fprintf(stderr, "error: realloc_space() does not expect a null pointer\n");
+      exit(EXIT_FAILURE);
+    }
+
+  if (bytes > m->capacity)
+    {
+      fprintf(stderr, "error: realloc_space() cannot grow a space past its mapping\n");
+      exit(EXIT_FAILURE);
+    }
+
+  release_pages(m->start + bytes, m->capacity - bytes);
+
+  pspace->end = pspace->start + size_requested;
+  pspace->size = size_requested;
+}
+
+#else
+
 void
 alloc_space(space_t * pspace, size_t size_requested)
 {
@@ -107,6 +296,8 @@ realloc_space(space_t * pspace, size_t size_requested)
   pspace->size = size_requested;
 }
 
+#endif
+
 
 
 
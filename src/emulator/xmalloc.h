@@ -31,6 +31,9 @@ extern void *xmalloc(size_t size);
 extern void alloc_space(space_t * pspace, size_t size_requested);
 extern void free_space(space_t * pspace);
 extern void realloc_space(space_t * pspace, size_t size_requested);
+#ifdef MMAP_SPACES
+extern void release_space_pages(ref_t * start, size_t size);
+#endif
 char *oak_c_string(ref_t * oakstr, int len);
 
 #endif